@@ -15,12 +15,14 @@ if len(sys.argv) == 1:
 xName = sys.argv[1]
 buildPath = 'build/'
 binaryPath = 'src/'
-compileFlags = []
+compileFlags = ['O3','march=native']
 linkFlags = []
 libLocations = []
 libraries = ['armadillo']
 fileList = ['main.cpp',
             'JacobiRotationProblem.cpp',
+            'EigenvalueCache.cpp',
+            'rotationKernel.cpp',
             'potentials.cpp']
 
 start = time.time()
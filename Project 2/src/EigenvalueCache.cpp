@@ -0,0 +1,212 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "EigenvalueCache.hpp"
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Identifies a cache record file.
+ */
+const char CACHE_MAGIC[8] = {'E','I','G','C','A','C','H','E'};
+
+/*
+ * Start of every record. It is followed by the eigenvalues, the bounds (if
+ * any) and the eigenvectors (if any), all as doubles. The key is stored so a
+ * hash collision can be detected.
+ */
+struct CacheRecordHeader {
+  char magic[8];
+  int version;
+  CacheKey key;
+  int numValues,numBounds,vectorRows,vectorCols;
+};
+
+/*
+ * @param directory Path to the directory holding the cache records. Must
+ * exist.
+ */
+EigenvalueCache :: EigenvalueCache(string directory) {
+  this->directory = directory;
+  hits = 0;
+  misses = 0;
+  stores = 0;
+}
+
+/*
+ * Looks for a record of the given problem. The record is memory mapped and
+ * copied out, no locks are taken.
+ *
+ * @param key The parameters of the problem.
+ * @param eigenvalues Filled with the eigenvalues if found.
+ * @param bounds Filled with eigenvalue bounds if found, may be empty.
+ * @param eigenvectors Filled with eigenvectors if found, may be empty.
+ *
+ * @return True if the problem was found.
+ */
+bool EigenvalueCache :: lookup(CacheKey key, vec& eigenvalues, vec& bounds,
+    mat& eigenvectors) {
+  string path = recordPath(key);
+
+  int fd = open(path.c_str(),O_RDONLY);
+  if (fd < 0) {
+    misses++;
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd,&info) != 0 || info.st_size < (off_t) sizeof(CacheRecordHeader)) {
+    close(fd);
+    misses++;
+    return false;
+  }
+
+  void* mapped = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    misses++;
+    return false;
+  }
+
+  const CacheRecordHeader* header = (const CacheRecordHeader*) mapped;
+  const double* data = (const double*) (header + 1);
+  size_t numDoubles = header->numValues + header->numBounds +
+    (size_t) header->vectorRows * header->vectorCols;
+
+  // Check that record is complete and really is the problem asked for
+  bool valid = memcmp(header->magic,CACHE_MAGIC,8) == 0 &&
+    header->version == SOLVER_VERSION &&
+    header->key.numElectrons == key.numElectrons &&
+    header->key.n == key.n &&
+    header->key.lowest == key.lowest &&
+    header->key.rhoMax == key.rhoMax &&
+    header->key.omegaR == key.omegaR &&
+    header->key.tolerance == key.tolerance &&
+    header->key.engine == key.engine &&
+    header->key.eigenvectors == key.eigenvectors &&
+    (size_t) info.st_size == sizeof(CacheRecordHeader) + numDoubles*sizeof(double);
+
+  if (valid) {
+    eigenvalues = vec(data,header->numValues);
+    data += header->numValues;
+
+    bounds = vec(data,header->numBounds);
+    data += header->numBounds;
+
+    eigenvectors = mat(data,header->vectorRows,header->vectorCols);
+    hits++;
+  } else {
+    misses++;
+  }
+
+  munmap(mapped,info.st_size);
+  return valid;
+}
+
+/*
+ * Stores the result of a problem. Written to a temporary file first, which is
+ * then renamed to the record name. If two processes store the same problem
+ * at once the last rename wins, and both records are complete.
+ *
+ * @param key The parameters of the problem.
+ * @param eigenvalues The eigenvalues found.
+ * @param bounds Eigenvalue bounds, may be empty.
+ * @param eigenvectors Eigenvectors as columns, may be empty.
+ */
+void EigenvalueCache :: store(CacheKey key, vec eigenvalues, vec bounds,
+    mat eigenvectors) {
+  CacheRecordHeader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,CACHE_MAGIC,8);
+  header.version = SOLVER_VERSION;
+  header.key = key;
+  header.numValues = eigenvalues.n_elem;
+  header.numBounds = bounds.n_elem;
+  header.vectorRows = eigenvectors.n_rows;
+  header.vectorCols = eigenvectors.n_cols;
+
+  // Temporary name is unique for this process
+  ostringstream oss;
+  oss << recordPath(key) << ".tmp." << getpid();
+  string tmpPath = oss.str();
+
+  FILE* outfile = fopen(tmpPath.c_str(),"wb");
+  if (outfile == NULL) {
+    cout << "Could not write to cache: " << tmpPath << endl;
+    return;
+  }
+
+  bool ok = fwrite(&header,sizeof(header),1,outfile) == 1;
+  ok = ok && fwrite(eigenvalues.memptr(),sizeof(double),eigenvalues.n_elem,
+      outfile) == eigenvalues.n_elem;
+  ok = ok && fwrite(bounds.memptr(),sizeof(double),bounds.n_elem,outfile) ==
+    bounds.n_elem;
+  ok = ok && fwrite(eigenvectors.memptr(),sizeof(double),eigenvectors.n_elem,
+      outfile) == eigenvectors.n_elem;
+  ok = (fclose(outfile) == 0) && ok;
+
+  if (!ok || rename(tmpPath.c_str(),recordPath(key).c_str()) != 0) {
+    cout << "Could not write to cache: " << recordPath(key) << endl;
+    remove(tmpPath.c_str());
+    return;
+  }
+
+  stores++;
+}
+
+/*
+ * Prints the number of hits, misses and stores done by this process.
+ */
+void EigenvalueCache :: printStatistics() {
+  int lookups = hits + misses;
+  cout << "Cache: " << hits << " hits, " << misses << " misses, " << stores
+    << " stored";
+  if (lookups > 0) {
+    cout << " (hit rate " << (100.0 * hits) / lookups << " %)";
+  }
+  cout << endl;
+}
+
+/*
+ * FNV-1a hash of the key and the solver version. Fields are hashed one by
+ * one, so padding in the struct does not matter.
+ *
+ * @param key The parameters of the problem.
+ */
+unsigned long long EigenvalueCache :: hashKey(CacheKey key) {
+  unsigned long long hash = 14695981039346656037ULL;
+  const int numFields = 9;
+  const void* fields[numFields] = {&SOLVER_VERSION,&key.numElectrons,&key.n,
+    &key.lowest,&key.rhoMax,&key.omegaR,&key.tolerance,&key.engine,
+    &key.eigenvectors};
+  size_t sizes[numFields] = {sizeof(int),sizeof(int),sizeof(int),sizeof(int),
+    sizeof(double),sizeof(double),sizeof(double),sizeof(int),sizeof(int)};
+
+  for (int f = 0; f < numFields; f++) {
+    const unsigned char* bytes = (const unsigned char*) fields[f];
+    for (size_t b = 0; b < sizes[f]; b++) {
+      hash ^= bytes[b];
+      hash *= 1099511628211ULL;
+    }
+  }
+
+  return hash;
+}
+
+/*
+ * @param key The parameters of the problem.
+ *
+ * @return Path to the record file of the problem.
+ */
+string EigenvalueCache :: recordPath(CacheKey key) {
+  char name[32];
+  sprintf(name,"%016llx.eig",hashKey(key));
+  return directory + "/" + name;
+}
@@ -0,0 +1,55 @@
+#ifndef EIGENVALUECACHE_HPP
+#define EIGENVALUECACHE_HPP
+
+#include <armadillo>
+#include <string>
+
+/*
+ * Version of the solvers. Must be bumped whenever a change to the solvers
+ * changes their results, so old cache records are not used.
+ *
+ * 2: Vectorized rotation kernel, and isolation check in solveLowest.
+ */
+const int SOLVER_VERSION = 2;
+
+/*
+ * The parameters that decide the result of a problem. Two problems with equal
+ * keys give equal eigenvalues.
+ */
+struct CacheKey {
+  int numElectrons;     // Decides which potential is used
+  int n;                // Size of matrix
+  int lowest;           // Number of lowest eigenvalues found, 0 if all
+  double rhoMax;
+  double omegaR;        // 0 for one electron
+  double tolerance;     // Error tolerance or eigenvalue tolerance
+  int engine;           // Engine that solved it, never ENGINE_AUTO
+  int eigenvectors;     // 1 if eigenvectors were found
+};
+
+/*
+ * Persistent cache of solved eigenvalue problems, stored as one binary file
+ * per problem in a directory. The file name is a hash of the key and the
+ * solver version, so the cache is content addressed.
+ *
+ * Records are written to a temporary file and renamed into place, which is
+ * atomic. Readers therefore never see half written records, and several
+ * processes can share a cache directory without any locking.
+ */
+class EigenvalueCache {
+  public:
+    EigenvalueCache(std::string);       // Takes path to cache directory
+
+    bool lookup(CacheKey,arma::vec&,arma::vec&,arma::mat&);
+    void store(CacheKey,arma::vec,arma::vec,arma::mat);
+    void printStatistics();
+
+  private:
+    std::string directory;
+    int hits,misses,stores;
+
+    unsigned long long hashKey(CacheKey);
+    std::string recordPath(CacheKey);
+};
+
+#endif // EIGENVALUECACHE_HPP
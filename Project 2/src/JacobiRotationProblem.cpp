@@ -2,6 +2,24 @@
 #include <fstream>
 
 #include "JacobiRotationProblem.hpp"
+#include "rotationKernel.hpp"
+
+/*
+ * Constants
+ */
+
+/*
+ * Smallest matrix that AUTO sends to the Householder engine. AUTO is only
+ * used if asked for, as the rotation counts are what the project studies,
+ * and the size is a rough guess that has not been measured.
+ */
+const int HOUSEHOLDER_MIN_SIZE = 30;
+
+/*
+ * Most rotations solveLowest may use, times n^2. The full solver needs some
+ * 3n^2 to 5n^2, so a run reaching this is not converging.
+ */
+const int MAX_ROTATIONS_FACTOR = 20;
 
 /*
  * Constructor
@@ -16,59 +34,131 @@ JacobiRotationProblem :: JacobiRotationProblem(mat newProblem) {
 
   // Set special fields
   finished = false;
+  hasParams = false;
+  wantEigenvectors = false;
   rotations = 0;
+  engine = ENGINE_JACOBI;
+  omegaR = 0;
+
+  // No cache unless asked for
+  cache = NULL;
+  hasCacheKey = false;
+  fromCache = false;
 }
 
 /*
- * Uses the algorithm to rearange the matrix into a diagonal matrix which will
- * contain the eigenvalues.
+ * Finds the eigenvalues of the matrix, by Jacobi rotations unless another
+ * engine is set with `setEngine`.
  *
  * @param errorTolerance The error tolerance to make all non-diagonal elements
- * smaller than.
+ * smaller than. Only used by the Jacobi engine, LAPACK converges to machine
+ * precision.
  */
 void JacobiRotationProblem :: solve(double errorTolerance) {
-  double a_ik,a_il,a_ll,a_kk,a_kl;
+  bool useHouseholder = engine == ENGINE_HOUSEHOLDER ||
+    (engine == ENGINE_AUTO && (int) matrix.n_rows >= HOUSEHOLDER_MIN_SIZE);
 
-  // Decide interval of progress update from matrix size
-  int progUpdate = (int) ( matrix.n_rows / 2.0 ) + 1;
-  int counter = 0;  // For counting progress updates
+  if (loadFromCache(0,errorTolerance,
+        useHouseholder ? ENGINE_HOUSEHOLDER : ENGINE_JACOBI)) {
+    return;
+  }
 
-  do {
-    // Update max non diag elm and coors
-    updateMaxNonDiagElm();
+  if (useHouseholder) {
+    solveHouseholder();
+  } else {
+    solveJacobi(errorTolerance);
+  }
 
-    // Fetch certain elements
-    a_ll = matrix(l,l);
-    a_kk = matrix(k,k);
-    a_kl = matrix(k,l);
+  finished = true;
+}
 
-    // Find new rotation values
-    updateRotationValues();
+/*
+ * Looks for the problem in the cache. Only possible when physical parameters
+ * are given, since they make up the key. If found the solver is finished.
+ *
+ * @param lowest Number of lowest eigenvalues wanted, 0 if all.
+ * @param tolerance The tolerance the solver was asked for.
+ * @param used The engine that will solve the problem, not ENGINE_AUTO.
+ *
+ * @return True if result was found in cache.
+ */
+bool JacobiRotationProblem :: loadFromCache(int lowest, double tolerance,
+    SolverEngine used) {
+  if (cache == NULL || !hasParams) {
+    return false;
+  }
 
-    matrix(k,l) = 0.0;
-    matrix(l,k) = 0.0;
+  cacheKey.numElectrons = numElectrons;
+  cacheKey.n = matrix.n_rows;
+  cacheKey.lowest = lowest;
+  cacheKey.rhoMax = rhoMax;
+  cacheKey.omegaR = numElectrons > 1 ? omegaR : 0;
+  cacheKey.tolerance = tolerance;
+  cacheKey.engine = used;
+  cacheKey.eigenvectors = wantEigenvectors ? 1 : 0;
+  hasCacheKey = true;
+
+  fromCache = cache->lookup(cacheKey,eigenvalues,eigenvalueBounds,eigenvectors);
+  if (fromCache) {
+    cout << "Found eigenvalues in cache, skipping solver." << endl;
+    finished = true;
+  }
 
-    // Perform rotation
-    matrix(k,k) = a_kk*c*c - 2*a_kl*c*s + a_ll*s*s;
-    matrix(l,l) = a_ll*c*c + 2*a_kl*c*s + a_kk*s*s;
+  return fromCache;
+}
 
-    for (int i = 0; i < matrix.n_rows; i++) {
-      if (i == k || i == l) {
-        // Skip diagonal elements
-        continue;
-      }
-      a_ik = matrix(i,k);
-      a_il = matrix(i,l);
+/*
+ * Reduces the matrix to tridiagonal form by Householder reflections and finds
+ * the eigenvalues of the tridiagonal matrix. Both steps are done by LAPACK
+ * through Armadillo: the reduction is blocked (dsytrd) and the tridiagonal
+ * problem is solved by divide and conquer (dstedc) when eigenvectors are
+ * wanted. The reflections are only applied back to form eigenvectors if these
+ * are asked for, else the cheaper eigenvalue only path (dsterf) is used.
+ */
+void JacobiRotationProblem :: solveHouseholder() {
+  bool success;
 
-      matrix(i,k) = a_ik*c - a_il*s;
-      matrix(k,i) = matrix(i,k);
+  if (wantEigenvectors) {
+    success = eig_sym(eigenvalues,eigenvectors,matrix,"dc");
+  } else {
+    success = eig_sym(eigenvalues,matrix);
+  }
 
-      matrix(i,l) = a_il*c + a_ik*s;
-      matrix(l,i) = matrix(i,l);
-    }
+  if (!success) {
+    cout << "Householder engine failed to find eigenvalues." << endl;
+    exit(1);
+  }
 
-    // Upp the number of rotations
-    rotations++;
+  // Leave the matrix in the same state the Jacobi engine would
+  matrix.zeros();
+  matrix.diag() = eigenvalues;
+
+  rotations = 0;
+}
+
+/*
+ * Uses the algorithm to rearange the matrix into a diagonal matrix which will
+ * contain the eigenvalues. If eigenvectors are wanted the rotations are
+ * accumulated, and the columns sorted as the eigenvalues.
+ *
+ * @param errorTolerance The error tolerance to make all non-diagonal elements
+ * smaller than.
+ */
+void JacobiRotationProblem :: solveJacobi(double errorTolerance) {
+  // Decide interval of progress update from matrix size
+  int progUpdate = (int) ( matrix.n_rows / 2.0 ) + 1;
+  int counter = 0;  // For counting progress updates
+
+  if (wantEigenvectors) {
+    eigenvectors = eye<mat>(matrix.n_rows,matrix.n_rows);
+  }
+
+  do {
+    // Update max non diag elm and coors
+    updateMaxNonDiagElm();
+
+    // Zero out element (k,l)
+    rotate();
 
     /*
      * Display progress. Progess is shown in current max non diag element and
@@ -87,9 +177,288 @@ void JacobiRotationProblem :: solve(double errorTolerance) {
   // Progress must end the line
   cout << endl;
 
+  eigenvalues = sort(matrix.diag());
+  if (wantEigenvectors) {
+    vec diagonal = matrix.diag();
+    eigenvectors = eigenvectors.cols(sort_index(diagonal));
+  }
+}
+
+/*
+ * Only converges the lowest eigenvalues. Rotations are done as in the full
+ * solver, but instead of waiting for all non diagonal elements to vanish the
+ * solver stops as soon as the numWanted smallest diagonal elements are
+ * certified to be within the tolerance of the numWanted lowest eigenvalues.
+ *
+ * For a symmetric matrix there is always an eigenvalue closer to a_pp than the
+ * residual r_p, the norm of the non diagonal part of column p. If in addition
+ * the Gershgorin disc of row p is disjoint from all other discs, it contains
+ * exactly one eigenvalue and the others are at least a distance gap away. The
+ * Kato-Temple bound r_p^2 / gap then holds, which is much sharper late in the
+ * run. The smaller of the two bounds is used.
+ *
+ * The bounds alone could let two diagonal elements point at the same
+ * eigenvalue, or miss one still hidden among the other rows. So the solver
+ * also waits till the intervals a_pp +- bound are disjoint, and till the
+ * discs of the wanted rows all lie below the discs of the other rows. The
+ * wanted discs then hold exactly numWanted eigenvalues, one in each interval,
+ * and all other eigenvalues are larger.
+ *
+ * Degenerate eigenvalues, or a wanted one tied with an unwanted one, are
+ * never separated. So the solver also stops when the norm of the whole non
+ * diagonal part is within the tolerance. By Weyl's inequality the sorted
+ * diagonal is then that close to the sorted eigenvalues, and that norm is
+ * the bound of every eigenvalue found.
+ *
+ * If the eigenvalues are not found within MAX_ROTATIONS_FACTOR*n^2
+ * rotations the program is stopped.
+ *
+ * Always uses Jacobi rotations, regardless of engine. If eigenvectors are
+ * wanted, those of the lowest eigenvalues are kept. Their error is about the
+ * residual, not the much smaller bound of the eigenvalues.
+ *
+ * @param numWanted How many of the lowest eigenvalues to find.
+ * @param eigenTolerance Max distance from a found to a true eigenvalue.
+ */
+void JacobiRotationProblem :: solveLowest(int numWanted, double eigenTolerance) {
+  int n = matrix.n_rows;
+  if (numWanted > n) {
+    numWanted = n;
+  }
+
+  if (loadFromCache(numWanted,eigenTolerance,ENGINE_JACOBI)) {
+    return;
+  }
+
+  uvec wanted = zeros<uvec>(numWanted); // Indices of smallest diagonal elms
+  vec bounds = zeros<vec>(numWanted);   // Bound for each of them
+  vec radii = zeros<vec>(n);            // Gershgorin radii of all rows
+  uvec isWanted = zeros<uvec>(n);       // 1 for the rows in wanted
+  double maxBound,offNorm;
+  bool separated;
+  long maxRotations = (long) MAX_ROTATIONS_FACTOR*n*n;
+
+  if (wantEigenvectors) {
+    eigenvectors = eye<mat>(n,n);
+  }
+
+  /*
+   * Checking the bounds costs as much as searching for one pivot, so it is
+   * only done as often as progress would be shown.
+   */
+  int checkEvery = (int) ( n / 2.0 ) + 1;
+
+  while (true) {
+    findSmallestDiagonal(wanted);
+
+    // Gershgorin radius of every row, symmetric so columns can be summed.
+    // Also the Frobenius norm of the non diagonal part
+    offNorm = 0;
+    for (int j = 0; j < n; j++) {
+      double sum = 0;
+      for (int i = 0; i < n; i++) {
+        if (i != j) {
+          sum += abs(matrix(i,j));
+          offNorm += matrix(i,j)*matrix(i,j);
+        }
+      }
+      radii(j) = sum;
+    }
+    offNorm = sqrt(offNorm);
+
+    maxBound = 0;
+    for (int w = 0; w < numWanted; w++) {
+      int p = wanted(w);
+      double a_pp = matrix(p,p);
+
+      // Residual of unit vector e_p
+      double sum = 0;
+      for (int i = 0; i < n; i++) {
+        if (i != p) { sum += matrix(i,p)*matrix(i,p); }
+      }
+      double residual = sqrt(sum);
+
+      // Distance from a_pp to the discs of all other rows
+      double gap = -1;
+      bool isolated = true;
+      for (int j = 0; j < n && isolated; j++) {
+        if (j == p) { continue; }
+        double dist = abs(matrix(j,j) - a_pp);
+        if (dist <= radii(j) + radii(p)) {
+          isolated = false;
+        } else if (gap < 0 || dist - radii(j) < gap) {
+          gap = dist - radii(j);
+        }
+      }
+
+      bounds(w) = residual;
+      if (isolated && gap > 0 && residual*residual / gap < residual) {
+        bounds(w) = residual*residual / gap;
+      }
+      if (bounds(w) > maxBound) {
+        maxBound = bounds(w);
+      }
+    }
+
+    // Intervals must be disjoint, they are sorted by their diagonal element
+    separated = true;
+    for (int w = 0; w + 1 < numWanted; w++) {
+      int p = wanted(w);
+      int q = wanted(w+1);
+      if (matrix(p,p) + bounds(w) >= matrix(q,q) - bounds(w+1)) {
+        separated = false;
+      }
+    }
+
+    // Wanted discs must lie below the discs of all other rows
+    isWanted.zeros();
+    double wantedTop = 0;
+    for (int w = 0; w < numWanted; w++) {
+      int p = wanted(w);
+      isWanted(p) = 1;
+      if (w == 0 || matrix(p,p) + radii(p) > wantedTop) {
+        wantedTop = matrix(p,p) + radii(p);
+      }
+    }
+    for (int j = 0; j < n && separated; j++) {
+      if (!isWanted(j) && matrix(j,j) - radii(j) <= wantedTop) {
+        separated = false;
+      }
+    }
+
+    if (maxBound <= eigenTolerance && separated) {
+      break;
+    }
+
+    // Weyl bound, holds also for degenerate eigenvalues
+    if (offNorm <= eigenTolerance) {
+      bounds.fill(offNorm);
+      break;
+    }
+
+    if (rotations >= maxRotations) {
+      cout << endl << "Lowest eigenvalues not found after " << rotations
+        << " rotations, bound is still " << maxBound << "." << endl;
+      exit(1);
+    }
+
+    // Display progress
+    cout << "\rBound: " << maxBound << " Diff: " <<
+      (maxBound - eigenTolerance) << (separated ? "" : " Not separated") <<
+      "             ";
+    cout.flush();
+
+    for (int r = 0; r < checkEvery; r++) {
+      // Update max non diag elm and coors
+      updateMaxNonDiagElm();
+      if (maxNonDiagElm == 0) {
+        // Already diagonal
+        break;
+      }
+
+      // Zero out element (k,l)
+      rotate();
+    }
+  }
+
+  // Progress must end the line
+  cout << endl;
+
+  // Wanted indices are already sorted by their diagonal element
+  eigenvalues = zeros<vec>(numWanted);
+  for (int w = 0; w < numWanted; w++) {
+    eigenvalues(w) = matrix(wanted(w),wanted(w));
+  }
+  eigenvalueBounds = bounds;
+  if (wantEigenvectors) {
+    eigenvectors = eigenvectors.cols(wanted);
+  }
+
+  cout << "Found " << numWanted << " lowest eigenvalues after " << rotations
+    << " rotations. Achieved bounds:" << endl;
+  for (int w = 0; w < numWanted; w++) {
+    cout << "  " << eigenvalues(w) << " +- " << bounds(w) << endl;
+  }
+
   finished = true;
 }
 
+/*
+ * Performs one rotation which zeroes out the element (k,l), using the current
+ * values of k and l.
+ *
+ * Columns k and l are rotated as whole contiguous arrays by the vectorized
+ * kernel, then copied over to rows k and l to keep the matrix symmetric. The
+ * 2x2 block where rows and columns k and l meet is overwritten last. Columns
+ * k and l of the eigenvectors are rotated the same way, if wanted.
+ */
+void JacobiRotationProblem :: rotate() {
+  double a_ll,a_kk,a_kl;
+  int n = matrix.n_rows;
+
+  // Fetch certain elements
+  a_ll = matrix(l,l);
+  a_kk = matrix(k,k);
+  a_kl = matrix(k,l);
+
+  // Find new rotation values
+  updateRotationValues();
+
+  // Rotate columns
+  double* colK = matrix.colptr(k);
+  double* colL = matrix.colptr(l);
+  rotateColumns(colK,colL,n,c,s);
+
+  // Mirror to rows
+  for (int i = 0; i < n; i++) {
+    matrix(k,i) = colK[i];
+    matrix(l,i) = colL[i];
+  }
+
+  // Diagonal elements and the element being zeroed
+  matrix(k,k) = a_kk*c*c - 2*a_kl*c*s + a_ll*s*s;
+  matrix(l,l) = a_ll*c*c + 2*a_kl*c*s + a_kk*s*s;
+  matrix(k,l) = 0.0;
+  matrix(l,k) = 0.0;
+
+  if (wantEigenvectors) {
+    rotateColumns(eigenvectors.colptr(k),eigenvectors.colptr(l),n,c,s);
+  }
+
+  // Upp the number of rotations
+  rotations++;
+}
+
+/*
+ * Finds the indices of the smallest diagonal elements, sorted from smallest.
+ * Partial insertion sort, so this is O(n*numWanted).
+ *
+ * @param wanted Vector to store indices in, its length is number wanted.
+ */
+void JacobiRotationProblem :: findSmallestDiagonal(uvec& wanted) {
+  int numWanted = wanted.n_elem;
+  int found = 0;
+
+  for (int i = 0; i < matrix.n_rows; i++) {
+    double a_ii = matrix(i,i);
+    if (found == numWanted && a_ii >= matrix(wanted(found-1),wanted(found-1))) {
+      continue;
+    }
+
+    // Shift bigger elements one place up and insert
+    int j = found < numWanted ? found : numWanted - 1;
+    while (j > 0 && matrix(wanted(j-1),wanted(j-1)) > a_ii) {
+      wanted(j) = wanted(j-1);
+      j--;
+    }
+    wanted(j) = i;
+
+    if (found < numWanted) {
+      found++;
+    }
+  }
+}
+
 /*
  * Find the rotation matrix from the current state of the matrix.
  */
@@ -162,8 +531,6 @@ void JacobiRotationProblem :: saveResult(string filename) {
   
   ofstream outfile;
   outfile.open(filename.c_str());
-  vec eigenvalues = matrix.diag();
-  eigenvalues = sort(eigenvalues);
 
   // Write header with metadata
   if (hasParams) {
@@ -174,14 +541,26 @@ void JacobiRotationProblem :: saveResult(string filename) {
       if (numElectrons > 1) {
         outfile << "omegaR: " << omegaR << endl;
       }
+      if (eigenvalueBounds.n_elem > 0) {
+        outfile << "bounds:";
+        for (int i = 0; i < eigenvalueBounds.n_elem; i++) {
+          outfile << " " << eigenvalueBounds(i);
+        }
+        outfile << endl;
+      }
       outfile << "***[SORTED EIGENVALUES]***" << endl;
   }
 
-  for (int i = 0; i < matrix.n_rows; i++) {
+  for (int i = 0; i < eigenvalues.n_elem; i++) {
     outfile << eigenvalues(i) << endl;
   }
   outfile.close();
   cout << "Saved eigenvalues to file: " << filename << endl;
+
+  // Store in cache, unless that is where it came from
+  if (cache != NULL && hasCacheKey && !fromCache) {
+    cache->store(cacheKey,eigenvalues,eigenvalueBounds,eigenvectors);
+  }
 }
 
 /*
@@ -210,8 +589,65 @@ void JacobiRotationProblem :: giveParameters(double rhoMax, int numElec, double
   omegaR = wr;
 }
 
+/*
+ * Forces a certain engine to be used when solving. Default is ENGINE_JACOBI,
+ * ENGINE_AUTO picks Householder for matrices of HOUSEHOLDER_MIN_SIZE and up.
+ *
+ * @param newEngine The engine to use.
+ */
+void JacobiRotationProblem :: setEngine(SolverEngine newEngine) {
+  engine = newEngine;
+}
+
+/*
+ * Whether eigenvectors are to be found when solving. Default is false.
+ *
+ * @param want True if eigenvectors are wanted.
+ */
+void JacobiRotationProblem :: computeEigenvectors(bool want) {
+  wantEigenvectors = want;
+}
+
+/*
+ * Makes the solver look for results in a cache before solving, and store
+ * them there when saved. The physical parameters must be given before solving
+ * for the cache to be used.
+ *
+ * @param newCache The cache to use. NULL turns off caching.
+ */
+void JacobiRotationProblem :: useCache(EigenvalueCache* newCache) {
+  cache = newCache;
+}
+
 /** Get methods **/
 
+/*
+ * Returns the residual bounds of the eigenvalues found by `solveLowest`.
+ * Empty if the full solver was used.
+ */
+vec JacobiRotationProblem :: getEigenvalueBounds() {
+  return eigenvalueBounds;
+}
+
+/*
+ * Returns the sorted eigenvalues, only the lowest if found by `solveLowest`.
+ * NULL if the solver has not run.
+ */
+double* JacobiRotationProblem :: getEigenvalues() {
+  if (!isFinished()) {
+    return NULL;
+  }
+  return eigenvalues.memptr();
+}
+
+/*
+ * Returns the eigenvectors as columns, in the order of the eigenvalues. Empty
+ * unless asked for with `computeEigenvectors` before solving.
+ */
+mat JacobiRotationProblem :: getEigenvectors() {
+  return eigenvectors;
+}
+
 /*
  * Returns the number of rotations needed to solve the problem. If solution is
  * not found yet it returns 0.
@@ -1,9 +1,18 @@
 // Are these two lines needed in this file?
 #include <armadillo>
 #include <stdlib.h>
+
+#include "EigenvalueCache.hpp"
+
 using namespace arma;
 using namespace std;
 
+/*
+ * Which algorithm to use for finding the eigenvalues. JACOBI is the default,
+ * AUTO picks from the size of the matrix.
+ */
+enum SolverEngine { ENGINE_AUTO, ENGINE_JACOBI, ENGINE_HOUSEHOLDER };
+
 /*
  * Represents a problem that uses the Jacobi rotation algorithm to find the
  * eigenvalues of a matrix.
@@ -19,9 +28,14 @@ class JacobiRotationProblem {
      */
     JacobiRotationProblem(mat);         // Constructor only takes matrix to solve
     int getNumRotations();              // Number of rotations used to solve
-    vec* getEigenvectors();             // Returns eigenvectors
+    mat getEigenvectors();              // Eigenvectors as columns, if wanted
     double* getEigenvalues();           // Returns eigenvalues
+    vec getEigenvalueBounds();          // Bounds found by solveLowest
     void solve(double);                 // Start algorithm, arg is error tolerance
+    void solveLowest(int,double);       // Only lowest k, to eigenvalue tolerance
+    void setEngine(SolverEngine);       // Force a certain engine, default JACOBI
+    void computeEigenvectors(bool);     // Switch for also finding eigenvectors
+    void useCache(EigenvalueCache*);    // Look up and store results in cache
     void printResultMatrix();           // If finished, prints complete matrix
     void saveResult(string);            // If finished, saves eigenvalues to file
 
@@ -36,8 +50,20 @@ class JacobiRotationProblem {
      * Fields
      */
     bool finished,hasParams;            // Switch telling if solver has run
+    bool wantEigenvectors;              // If eigenvectors are to be found
     int rotations,k,l;                  // Int fields for coors and rotations
     mat matrix,originalMatrix;          // Matrix fields
+    vec eigenvalues;                    // Sorted eigenvalues when finished
+    vec eigenvalueBounds;               // Residual bounds from solveLowest
+    mat eigenvectors;                   // Columns are eigenvectors, if found
+    SolverEngine engine;                // Engine used when solving
+
+    /*
+     * Result cache, NULL if not used
+     */
+    EigenvalueCache* cache;
+    CacheKey cacheKey;                  // Key of the last solve
+    bool hasCacheKey,fromCache;         // If key is set and if result is cached
     double t,c,s,maxNonDiagElm;         // For storing rotation values and maxelm
 
     /*
@@ -49,6 +75,11 @@ class JacobiRotationProblem {
     /*
      * Functions
      */
+    bool loadFromCache(int,double,SolverEngine); // Looks up result, true if found
+    void solveJacobi(double);           // Jacobi rotations till tolerance
+    void solveHouseholder();            // Tridiagonalization and LAPACK
+    void rotate();                      // Zeroes element (k,l)
+    void findSmallestDiagonal(uvec&);   // Indices of smallest diagonal elms
     void updateRotationValues();        // Finds rotation values
     void updateMaxNonDiagElm();         // Updates max non diag elm (and coors)
     bool isFinished();                  // If rotations is run
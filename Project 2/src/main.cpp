@@ -1,8 +1,10 @@
 #include <stdlib.h>
+#include <ctime>
 #include <armadillo>
 
 #include "JacobiRotationProblem.hpp"
 #include "potentials.hpp"
+#include "rotationKernel.hpp"
 
 using namespace std;
 using namespace arma;
@@ -13,24 +15,53 @@ const double HBAR = 1.05457173e-34; // [m^2 kg / s]
 const double ALPHA = pow( (HBAR * HBAR) / (M_ELECTRON * K), 0.25);
 const double C_LAMBDA = (2.0 * M_ELECTRON * ALPHA * ALPHA ) / (HBAR * HBAR);
 
-void radialSchrodingerOneElectron(double,int,string);
-void radialSchrodingerTwoElectrons(double,int,double,string);
+/*
+ * How a problem is to be solved, as given on the commandline.
+ */
+struct SolverSettings {
+  SolverEngine engine;      // Which engine to solve with
+  int lowest;               // Only find this many lowest eigenvalues, 0 if all
+  double eigenTolerance;    // Tolerance for eigenvalues when only finding lowest
+  EigenvalueCache* cache;   // Cache of earlier results, NULL if not used
+};
+
+void radialSchrodingerOneElectron(double,int,string,SolverSettings);
+void radialSchrodingerTwoElectrons(double,int,double,string,SolverSettings);
+void solveProblem(JacobiRotationProblem&,SolverSettings);
 void testCaseSymmetricMatrix();
+bool testCaseDegenerateLowest();
+void benchmarkRotationKernel();
 
 int main(int argc, char *argv[]) {
   // Print usage if lacking certain number of electrons
-  string usage = "Usage: ./<exe>.x -#e <#electrons> -n <Size matrix> -wr <omega r> -rhoMax <max radius> -o <savefilename>";
+  string usage = "Usage: ./<exe>.x -#e <#electrons> -n <Size matrix> -wr <omega r> -rhoMax <max radius> -o <savefilename> [-engine jacobi/householder/auto] [-lowest <k> -eigTol <tolerance>] [-cache <directory>]\n       ./<exe>.x -benchKernel\n       ./<exe>.x -test";
   if (argc < 2) {
     cout << usage << endl;
     return 1;
   }
 
+  if (strcmp(argv[1],"-benchKernel") == 0) {
+    benchmarkRotationKernel();
+    return 0;
+  }
+
+  if (strcmp(argv[1],"-test") == 0) {
+    return testCaseDegenerateLowest() ? 0 : 1;
+  }
+
   // For storing commandline arguments
   int electrons = 0;
   int n = 0;
   double omegaR = 0;
   string savefile = " ";
   double rhoMax = 0;
+  string cachePath = "";
+
+  SolverSettings settings;
+  settings.engine = ENGINE_JACOBI;
+  settings.lowest = 0;
+  settings.eigenTolerance = 1e-6;
+  settings.cache = NULL;
 
   // Traverse commandline and store
   for (int i = 1; i < argc; i++) {
@@ -49,6 +80,25 @@ int main(int argc, char *argv[]) {
     } else if (strcmp(argv[i],"-o") == 0) {
       savefile = argv[i+1];
       i++;
+    } else if (strcmp(argv[i],"-engine") == 0) {
+      if (strcmp(argv[i+1],"auto") == 0) {
+        settings.engine = ENGINE_AUTO;
+      } else if (strcmp(argv[i+1],"householder") == 0) {
+        settings.engine = ENGINE_HOUSEHOLDER;
+      } else if (strcmp(argv[i+1],"jacobi") != 0) {
+        cout << "Unknown engine: " << argv[i+1] << endl;
+        return 1;
+      }
+      i++;
+    } else if (strcmp(argv[i],"-lowest") == 0) {
+      settings.lowest = atoi(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-eigTol") == 0) {
+      settings.eigenTolerance = atof(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-cache") == 0) {
+      cachePath = argv[i+1];
+      i++;
     }
   }
 
@@ -71,15 +121,24 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  if (cachePath != "") {
+    settings.cache = new EigenvalueCache(cachePath);
+  }
+
   // Run correct simulation
   if (electrons == 1) {
-    radialSchrodingerOneElectron(rhoMax,n,savefile);
+    radialSchrodingerOneElectron(rhoMax,n,savefile,settings);
   } else if (electrons == 2) {
     if (omegaR == 0) {
       cout << "Can't run for two electrons without strength of oscillator." << endl;
       return 1;
     }
-    radialSchrodingerTwoElectrons(rhoMax,n,omegaR,savefile);
+    radialSchrodingerTwoElectrons(rhoMax,n,omegaR,savefile,settings);
+  }
+
+  if (settings.cache != NULL) {
+    settings.cache->printStatistics();
+    delete settings.cache;
   }
 
   return 0;
@@ -93,8 +152,10 @@ int main(int argc, char *argv[]) {
  * @param rhoMax Dimensionless max radius.
  * @param n Size of matrix.
  * @param savefile File to save eigenvalues to as sorted list.
+ * @param settings How to solve the problem.
  */
-void radialSchrodingerOneElectron(double rhoMax, int n, string savefile) {
+void radialSchrodingerOneElectron(double rhoMax, int n, string savefile,
+    SolverSettings settings) {
   double rhoMin = 0;                            // Minimum dimensionless radius
   double h = (rhoMax - rhoMin) / (double) (n+1);  // Step size
   double E = -1.0 / (h*h);                    // Non-diagonal elements value
@@ -119,8 +180,8 @@ void radialSchrodingerOneElectron(double rhoMax, int n, string savefile) {
 
   // Solve with Jacobis method
   JacobiRotationProblem prob = JacobiRotationProblem(problem);
-  prob.solve(1e-8);
   prob.giveParameters(rhoMax,1);
+  solveProblem(prob,settings);
   prob.saveResult(savefile);
 }
 
@@ -132,8 +193,10 @@ void radialSchrodingerOneElectron(double rhoMax, int n, string savefile) {
  * @param n Size of matrix.
  * @param omegaR Parameter decing strength of harmonic oscillator potential.
  * @param savefile File to save eigenvalues to as sorted list.
+ * @param settings How to solve the problem.
  */
-void radialSchrodingerTwoElectrons(double rhoMax, int n, double omegaR, string savefile) {
+void radialSchrodingerTwoElectrons(double rhoMax, int n, double omegaR,
+    string savefile, SolverSettings settings) {
   double rhoMin = 0;                            // Minimum dimensionless radius
   double h = (rhoMax - rhoMin) / (double) (n+1);  // Step size
   double E = -1.0 / (h*h);                    // Non-diagonal elements value
@@ -158,11 +221,29 @@ void radialSchrodingerTwoElectrons(double rhoMax, int n, double omegaR, string s
 
   // Solve with Jacobis method
   JacobiRotationProblem prob = JacobiRotationProblem(problem);
-  prob.solve(1e-8);
   prob.giveParameters(rhoMax,2,omegaR);
+  solveProblem(prob,settings);
   prob.saveResult(savefile);
 }
 
+/*
+ * Solves for all eigenvalues, or only the lowest if asked for. Parameters
+ * must be given to the problem first, since they are the key in the cache.
+ *
+ * @param prob The problem to solve.
+ * @param settings How to solve the problem.
+ */
+void solveProblem(JacobiRotationProblem& prob, SolverSettings settings) {
+  prob.setEngine(settings.engine);
+  prob.useCache(settings.cache);
+
+  if (settings.lowest > 0) {
+    prob.solveLowest(settings.lowest,settings.eigenTolerance);
+  } else {
+    prob.solve(1e-8);
+  }
+}
+
 /*
  * Contains a simple test case. Eigenvectors should be 8, 3 and 6.
  */
@@ -185,3 +266,119 @@ void testCaseSymmetricMatrix() {
   prob.solve(1e-8);
   prob.printResultMatrix();
 }
+
+/*
+ * Test case for `solveLowest` with degenerate eigenvalues, which are never
+ * separated. First a diagonal matrix with eigenvalues 1, 1, 2, 3 and 3, which
+ * is solved without rotations. Then the same eigenvalues turned by a
+ * Householder reflection, once asking for the two lowest and once for the
+ * four lowest, where the fourth is tied with the fifth.
+ *
+ * @return True if all eigenvalues are within their bounds.
+ */
+bool testCaseDegenerateLowest() {
+  vec spectrum(5);
+  spectrum(0) = 3;
+  spectrum(1) = 1;
+  spectrum(2) = 2;
+  spectrum(3) = 3;
+  spectrum(4) = 1;
+  vec expected = sort(spectrum);
+
+  // Reflection I - 2vv^T/(v^Tv) is orthogonal and symmetric
+  vec v(5);
+  v(0) = 1;
+  v(1) = -2;
+  v(2) = 0.5;
+  v(3) = 3;
+  v(4) = -1;
+  mat Q = eye<mat>(5,5) - 2.0/dot(v,v) * v*v.t();
+
+  mat diagonal = zeros<mat>(5,5);
+  diagonal.diag() = spectrum;
+  mat turned = Q*diagonal*Q;
+  turned = 0.5*(turned + turned.t());
+
+  mat problems[] = {diagonal, turned, turned};
+  int numWanted[] = {2, 2, 4};
+  double tolerance = 1e-8;
+  bool passed = true;
+
+  for (int m = 0; m < 3; m++) {
+    JacobiRotationProblem prob = JacobiRotationProblem(problems[m]);
+    prob.solveLowest(numWanted[m],tolerance);
+    double* found = prob.getEigenvalues();
+    vec bounds = prob.getEigenvalueBounds();
+
+    for (int w = 0; w < numWanted[m]; w++) {
+      if (abs(found[w] - expected(w)) > bounds(w) || bounds(w) > tolerance) {
+        cout << "Case " << m << ": eigenvalue " << w << " is " << found[w]
+          << " +- " << bounds(w) << ", expected " << expected(w) << endl;
+        passed = false;
+      }
+    }
+  }
+
+  cout << (passed ? "Degenerate test passed." : "Degenerate test failed.")
+    << endl;
+  return passed;
+}
+
+/*
+ * Measures the time of one rotation for the vectorized kernel against the
+ * old element by element loop, for matrices of size 100 to 2000.
+ */
+void benchmarkRotationKernel() {
+  int sizes[] = {100, 200, 500, 1000, 2000};
+  int numSizes = 5;
+  double c = cos(0.3);
+  double s = sin(0.3);
+
+  cout << "Rotation kernel: " << rotationKernelName() << endl;
+  cout << "n    loop [us]   kernel [us]   speedup" << endl;
+
+  for (int m = 0; m < numSizes; m++) {
+    int n = sizes[m];
+    int numRotations = 200000000 / (n*n) + 100;
+    mat A = randu<mat>(n,n);
+    A = A + A.t();
+
+    // Same pairs for both
+    srand(1);
+    clock_t start = clock();
+    for (int r = 0; r < numRotations; r++) {
+      int k = rand() % n;
+      int l = (k + 1 + rand() % (n-1)) % n;
+      for (int i = 0; i < n; i++) {
+        if (i == k || i == l) {
+          continue;
+        }
+        double a_ik = A(i,k);
+        double a_il = A(i,l);
+        A(i,k) = a_ik*c - a_il*s;
+        A(k,i) = A(i,k);
+        A(i,l) = a_il*c + a_ik*s;
+        A(l,i) = A(i,l);
+      }
+    }
+    double loopTime = (clock() - start) / (double) CLOCKS_PER_SEC;
+
+    srand(1);
+    start = clock();
+    for (int r = 0; r < numRotations; r++) {
+      int k = rand() % n;
+      int l = (k + 1 + rand() % (n-1)) % n;
+      double* colK = A.colptr(k);
+      double* colL = A.colptr(l);
+      rotateColumns(colK,colL,n,c,s);
+      for (int i = 0; i < n; i++) {
+        A(k,i) = colK[i];
+        A(l,i) = colL[i];
+      }
+    }
+    double kernelTime = (clock() - start) / (double) CLOCKS_PER_SEC;
+
+    cout << n << "  " << 1e6 * loopTime / numRotations << "  " <<
+      1e6 * kernelTime / numRotations << "  " << loopTime / kernelTime << endl;
+  }
+}
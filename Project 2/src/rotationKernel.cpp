@@ -0,0 +1,70 @@
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "rotationKernel.hpp"
+
+/*
+ * Applies a Givens rotation to two columns, stored contiguously:
+ *
+ *   a_ik <- a_ik*c - a_il*s
+ *   a_il <- a_il*c + a_ik*s
+ *
+ * for all rows i. There is no branch for the diagonal elements, the caller
+ * must overwrite rows k and l afterwards. Uses AVX-512 or AVX when compiled
+ * for it (-march=native), else a plain loop the compiler may vectorize.
+ *
+ * @param colK Pointer to first element of column k.
+ * @param colL Pointer to first element of column l.
+ * @param n Number of rows.
+ * @param c Cosine of rotation angle.
+ * @param s Sine of rotation angle.
+ */
+void rotateColumns(double* colK, double* colL, int n, double c, double s) {
+  int i = 0;
+
+#if defined(__AVX512F__)
+  __m512d vc = _mm512_set1_pd(c);
+  __m512d vs = _mm512_set1_pd(s);
+  for (; i + 8 <= n; i += 8) {
+    __m512d a_ik = _mm512_loadu_pd(colK + i);
+    __m512d a_il = _mm512_loadu_pd(colL + i);
+    _mm512_storeu_pd(colK + i,
+        _mm512_sub_pd(_mm512_mul_pd(a_ik,vc),_mm512_mul_pd(a_il,vs)));
+    _mm512_storeu_pd(colL + i,
+        _mm512_add_pd(_mm512_mul_pd(a_il,vc),_mm512_mul_pd(a_ik,vs)));
+  }
+#elif defined(__AVX__)
+  __m256d vc = _mm256_set1_pd(c);
+  __m256d vs = _mm256_set1_pd(s);
+  for (; i + 4 <= n; i += 4) {
+    __m256d a_ik = _mm256_loadu_pd(colK + i);
+    __m256d a_il = _mm256_loadu_pd(colL + i);
+    _mm256_storeu_pd(colK + i,
+        _mm256_sub_pd(_mm256_mul_pd(a_ik,vc),_mm256_mul_pd(a_il,vs)));
+    _mm256_storeu_pd(colL + i,
+        _mm256_add_pd(_mm256_mul_pd(a_il,vc),_mm256_mul_pd(a_ik,vs)));
+  }
+#endif
+
+  // Scalar fallback, and remainder of vector loop
+  for (; i < n; i++) {
+    double a_ik = colK[i];
+    double a_il = colL[i];
+    colK[i] = a_ik*c - a_il*s;
+    colL[i] = a_il*c + a_ik*s;
+  }
+}
+
+/*
+ * @return Name of the instruction set the kernel was compiled for.
+ */
+const char* rotationKernelName() {
+#if defined(__AVX512F__)
+  return "AVX-512";
+#elif defined(__AVX__)
+  return "AVX";
+#else
+  return "scalar";
+#endif
+}
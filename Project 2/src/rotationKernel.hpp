@@ -0,0 +1,7 @@
+#ifndef ROTATIONKERNEL_HPP
+#define ROTATIONKERNEL_HPP
+
+void rotateColumns(double*,double*,int,double,double);
+const char* rotationKernelName();
+
+#endif // ROTATIONKERNEL_HPP
@@ -58,15 +58,17 @@ class Project(object):
 # Clear screen first
 os.system('clear')
 
+# Metafile can be given, e.g. for the benchmark executable
+metafile = 'meta.dat'
+if len(sys.argv) > 1:
+    metafile = sys.argv[1]
+
 # Check that metafile is present
-for contents in os.listdir('.'):
-    if contents == 'meta.dat':
-        break;
-    if contents == os.listdir('.')[-1] and contents != 'meta.dat':
-        print 'No meta.dat file found in root of project (or here).'
-        sys.exit(1)
+if not os.path.isfile(metafile):
+    print 'No %s file found in root of project (or here).' % metafile
+    sys.exit(1)
 # Load metafile
-p = Project('meta.dat')
+p = Project(metafile)
 
 start = time.time()
 
@@ -109,7 +111,9 @@ if len(p()['linkFlags']) != 0:
 else:
     linkstring = 'c++ -o %s%s ' % (p()['buildDir'],p()['exe'])
 
-linkstring += '%s*.o ' % p()['buildDir']
+# Only the files of this executable, others may share the build directory
+for cfile in p()['files']:
+    linkstring += '%s%s.o ' % (p()['buildDir'],cfile.split('.')[0])
 
 if len(p()['libLocations']) != 0:
     for libPath in p()['libLocations']:
@@ -9,124 +9,81 @@ simulations of the solar system.
 """
 from matplotlib import pyplot as plt
 import numpy as np
-import os,sys
+import os,sys,struct
 
 """Constants"""
 
 _OBJECTS_PATH = '../data/objects/'
+_TRAJECTORY_FILE = 'trajectory.bin'
+_PARTICLES_FILE = 'particles.bin'
 _PLOT_EVERY = 100
 _XLIM = 50
 _YLIM = 50
 
 """Classes"""
 
-class ObjectData(object):
+class Trajectory(object):
     """
-    Contains the data for one single object.
+    Contains the positions of all objects, read from the binary trajectory
+    file written by the simulation. The positions are memory mapped, so only
+    the parts used are read from disk.
     """
     def __init__(self, datafile):
         """
-        Name for object is found in datafile.
+        Reads the header, then maps the frames following it.
 
-        @param datafile The file containing positional data.
+        @param datafile The binary trajectory file.
         """
-        self._file = datafile
-        self.name = self._findName()
-        self.currentLine = 0
-        self.allDataRead = False
+        inData = open(datafile,'rb')
 
-    def getNext(self):
-        """
-        @return The next x,y pair from datafile.
-        """
-        inData = open(self._file,'r')
-
-        # Read til end of header
-        while True:
-            if inData.readline().startswith('#syntax'):
-                break
+        if inData.read(8) != b'SSTRAJ01':
+            print 'If you see this the datafile has wrong syntax.'
+            sys.exit(1)
 
-        # Read til the next line and save x,y pair
-        counter = 0
-        while counter < self.currentLine:
-            inData.readline()
-            counter += 1
+        self.dimension,self.N,self.saveEach = struct.unpack('3i',inData.read(12))
+        self.dt = struct.unpack('d',inData.read(8))[0]
+        length = struct.unpack('i',inData.read(4))[0]
+        self.units = inData.read(length)
 
-        # Save correct x,y pair
-        x,y = np.asarray(inData.readline().strip().split(),float)
+        self.names = []
+        self.masses = np.zeros(self.N)
+        for i in range(self.N):
+            length = struct.unpack('i',inData.read(4))[0]
+            self.names.append(inData.read(length))
+            self.masses[i] = struct.unpack('d',inData.read(8))[0]
 
-        # Close file
+        offset = inData.tell()
         inData.close()
 
-        # Update what is next line
-        self.currentLine += 1
+        # Each frame is t followed by all x, then all y and so on
+        frameSize = 1 + self.dimension*self.N
+        numFrames = (os.path.getsize(datafile) - offset) / (8*frameSize)
+        self._frames = np.memmap(datafile, dtype=np.float64, mode='r',
+                offset=offset, shape=(numFrames,frameSize))
 
-        return x,y
+        self.t = self._frames[:,0]
 
-    def readAllData(self):
+    def positions(self, i):
         """
-        Reads datafile and puts into arrays.
+        @param i Index of object.
+        @return Array of coordinates of object i, one row for each dimension.
         """
-        if self.allDataRead:
-            print 'All data already read. Returning.'
-            return
-
-        inData = open(self._file, 'r')
-        x = []
-        y = []
-
-        # First read till end of header
-        for line in inData:
-            if line.startswith('#syntax'):
-                break
+        return np.array([self._frames[:,1 + d*self.N + i]
+            for d in range(self.dimension)])
 
-        for line in inData:
-            columns = line.strip().split()
-            x.append(columns[0])
-            y.append(columns[1])
-
-        self.x,self.y = np.asarray(x), np.asarray(y)
-        inData.close()
-        self.allDataRead = True
-
-    def hasNextPoint(self):
+    def frame(self, n):
         """
-        Says whether there are more points left in datafile. Tries to fetch
-        more data from file. If that fails because of something, returns False.
-        Else returns True.
+        @param n Index of frame.
+        @return Array of coordinates of all objects at frame n, one row for
+        each dimension.
         """
-        try:
-            self.getNext()
-        except:
-            return False
-
-        return True
-
-    def _findName(self):
-        """
-        Finds the name of the object from the datafile.
-
-        @param datafile The file containing data.
-        """
-        inData = open(self._file, 'r')
-
-        for line in inData:
-            if line.startswith('Positions'):
-                inData.close()
-                return line.strip().split(':')[1].strip()
-        
-        # Rapid err msg, no time dude
-        print 'If you see this the datafile has wrong syntax.'
-        sys.exit(1)
+        return self._frames[n,1:].reshape(self.dimension,self.N)
 
     def __len__(self):
         """
-        Length means number of x,y points.
+        Length means number of frames.
         """
-        if not self.allDataRead:
-            print "Cannot find length when all data isn't read. Returning."
-
-        return len(self.x)
+        return self._frames.shape[0]
 
 """Methods"""
 
@@ -145,7 +102,7 @@ if __name__ == '__main__':
         print 'Command line argument must be True or False.'
         sys.exit(1)
 
-    files = os.listdir(_OBJECTS_PATH)
+    data = Trajectory(os.path.join(_OBJECTS_PATH,_TRAJECTORY_FILE))
 
     plt.ion()
     fig = plt.figure()
@@ -159,28 +116,33 @@ if __name__ == '__main__':
     ax.set_xlim([-_XLIM,_XLIM])
 
     if animate:
-        datafiles = {}
-        lines = {}
-        for datafile in files:
-            newDataObject = ObjectData(os.path.join(_OBJECTS_PATH,datafile))
-            datafiles[newDataObject.name] = newDataObject
-            x,y = newDataObject.getNext()
-            lines[newDataObject.name] = ax.plot(x,y,'o',label=newDataObject.name)[0]
+        lines = []
+        for i in range(data.N):
+            x,y = data.frame(0)[:2,i]
+            lines.append(ax.plot(x,y,'o',label=data.names[i])[0])
 
         plt.draw()
         ax.legend(loc='best')
 
-        while datafiles[datafiles.keys()[0]].hasNextPoint():
-            for name in lines.keys():
-                x,y = datafiles[name].getNext()
-                lines[name].set_data(x,y)
+        for n in range(1,len(data),_PLOT_EVERY):
+            positions = data.frame(n)
+            for i in range(data.N):
+                lines[i].set_data(positions[0,i],positions[1,i])
 
             plt.draw()
 
     else:
-        for datafile in files:
-            data = ObjectData(os.path.join(_OBJECTS_PATH,datafile))
-            ax.plot(data.x,data.y,label=data.name)
+        for i in range(data.N):
+            x,y = data.positions(i)[:2]
+            ax.plot(x,y,label=data.names[i])
+        ax.legend(loc='best')
+
+    # Test particles are shown where they were last saved
+    particlesFile = os.path.join(_OBJECTS_PATH,_PARTICLES_FILE)
+    if os.path.exists(particlesFile):
+        particles = Trajectory(particlesFile)
+        positions = particles.frame(len(particles) - 1)
+        ax.plot(positions[0],positions[1],',k')
 
     plt.ioff()
     plt.show()
@@ -0,0 +1,101 @@
+#ifndef BUTCHERTABLEAU_HPP
+#define BUTCHERTABLEAU_HPP
+
+/*
+ * Butcher tableaus of explicit Runge-Kutta schemes, known at compile time.
+ * Row s of a holds the weights of the earlier stages in stage s, and the last
+ * row holds the weights b of the stages in the step. The nodes c are not
+ * needed, as gravity does not depend on time.
+ *
+ * A new scheme needs a tableau here, the definition of its `a` in
+ * SolarSystemExplicitRK.cpp, a name in `IntegrationMethod`, a case in
+ * `SolarSystem::advanceRungeKutta` and in `SolarSystem::advance`, and its name
+ * in the method parser of main.cpp and in `METHODS` of workPrecision.cpp.
+ * Tableaus of more than `RK_MAX_STAGES` stages do not compile.
+ */
+
+/*
+ * The classic fourth order scheme.
+ */
+struct RK4Tableau {
+  static const int stages = 4;
+  static constexpr double a[stages+1][stages] = {
+    {0},
+    {1./2},
+    {0, 1./2},
+    {0, 0, 1},
+    {1./6, 1./3, 1./3, 1./6}
+  };
+};
+
+/*
+ * Kutta's 3/8 rule, also of fourth order.
+ */
+struct RK38Tableau {
+  static const int stages = 4;
+  static constexpr double a[stages+1][stages] = {
+    {0},
+    {1./3},
+    {-1./3, 1},
+    {1, -1, 1},
+    {1./8, 3./8, 3./8, 1./8}
+  };
+};
+
+/*
+ * Strong stability preserving scheme of third order, Shu and Osher (1988).
+ */
+struct SSPRK3Tableau {
+  static const int stages = 3;
+  static constexpr double a[stages+1][stages] = {
+    {0},
+    {1},
+    {1./4, 1./4},
+    {1./6, 1./6, 2./3}
+  };
+};
+
+/*
+ * The fifth order solution of the Dormand-Prince 5(4) pair, with a fixed
+ * step. The seventh stage is only used for the error estimate, so left out.
+ */
+struct DormandPrince5Tableau {
+  static const int stages = 6;
+  static constexpr double a[stages+1][stages] = {
+    {0},
+    {1./5},
+    {3./40, 9./40},
+    {44./45, -56./15, 32./9},
+    {19372./6561, -25360./2187, 64448./6561, -212./729},
+    {9017./3168, -355./33, 46732./5247, 49./176, -5103./18656},
+    {35./384, 0, 500./1113, 125./192, -2187./6784, 11./84}
+  };
+};
+
+/*
+ * Sum over stages k < n of a[row][k]*K[k][i], written out at compile time.
+ * Stages with zero weight are left out of the sum.
+ */
+template <class Tableau, int row, int n,
+  bool nonzero = (n > 0 && Tableau::a[row][n > 0 ? n-1 : 0] != 0)>
+struct StageSum {
+  static inline double of(const double* const* K, int i) {
+    return StageSum<Tableau,row,n-1>::of(K,i) + Tableau::a[row][n-1]*K[n-1][i];
+  }
+};
+
+template <class Tableau, int row, int n>
+struct StageSum<Tableau,row,n,false> {
+  static inline double of(const double* const* K, int i) {
+    return StageSum<Tableau,row,n-1>::of(K,i);
+  }
+};
+
+template <class Tableau, int row>
+struct StageSum<Tableau,row,0,false> {
+  static inline double of(const double* const*, int) {
+    return 0;
+  }
+};
+
+#endif // BUTCHERTABLEAU_HPP
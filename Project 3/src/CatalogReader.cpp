@@ -0,0 +1,416 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "CatalogReader.hpp"
+
+using namespace std;
+
+/*
+ * Column names for each coordinate.
+ */
+const char* POSITION_NAMES[3] = {"x0","y0","z0"};
+const char* VELOCITY_NAMES[3] = {"v0x","v0y","v0z"};
+
+/*
+ * Powers of ten exactly representable as doubles.
+ */
+const double EXACT_POWERS[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Reads eight digits at once if the next eight characters all are digits.
+ * The characters are loaded as one little endian word and combined pairwise
+ * by multiplications, instead of one digit after the other.
+ *
+ * @param p First character.
+ * @param value Set to the number the eight digits make.
+ * @return If all eight were digits.
+ */
+static inline bool eightDigits(const char* p, unsigned long long& value) {
+  unsigned long long chunk;
+  memcpy(&chunk,p,8);
+
+  // High nibble of every byte must be 3, and adding 6 must not carry into it
+  if (((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+        (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) !=
+      0x3333333333333333ULL) {
+    return false;
+  }
+
+  chunk -= 0x3030303030303030ULL;
+  chunk = chunk*10 + (chunk >> 8);
+  value = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+      (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  return true;
+}
+
+/*
+ * Gathers digits into a number, eight at a time while there are that many.
+ *
+ * @param p First character, moved past the digits.
+ * @param finish One past last character of the token.
+ * @param digits The digits read so far, the new ones are appended.
+ */
+static inline void readDigits(const char*& p, const char* finish,
+    unsigned long long& digits) {
+  unsigned long long eight;
+  while (finish - p >= 8 && eightDigits(p,eight)) {
+    digits = 100000000ULL*digits + eight;
+    p += 8;
+  }
+  while (p < finish && (unsigned) (*p - '0') < 10) {
+    digits = 10*digits + (*p - '0');
+    p++;
+  }
+}
+
+/*
+ * Parses a decimal number. If the digits fit in 2^53 and the power of ten
+ * is at most 22, both are exact doubles and one multiplication or division
+ * gives the correctly rounded result (Clinger's fast path). Other numbers are
+ * left to strtod, so the result is always the same as strtod gives.
+ *
+ * @param begin First character of number.
+ * @param finish One past last character of number.
+ * @param valid Set to false if the token is not a number, else left.
+ * @return The number.
+ */
+double parseNumber(const char* begin, const char* finish, bool& valid) {
+  const char* p = begin;
+  bool negative = false;
+  if (p < finish && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  // All digits are gathered, the point only moves the exponent. Digits past
+  // the 19th overflow, but then the fast path is not taken.
+  unsigned long long digits = 0;
+  const char* start = p;
+  readDigits(p,finish,digits);
+  int numDigits = p - start;
+  int exponent = 0;
+
+  if (p < finish && *p == '.') {
+    p++;
+    const char* fraction = p;
+    readDigits(p,finish,digits);
+    numDigits += p - fraction;
+    exponent = fraction - p;
+  }
+
+  bool exponentValid = true;
+  if (numDigits > 0 && p < finish && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negativeExponent = false;
+    if (p < finish && (*p == '-' || *p == '+')) {
+      negativeExponent = *p == '-';
+      p++;
+    }
+    const char* exponentStart = p;
+    int e = 0;
+    while (p < finish && (unsigned) (*p - '0') < 10) {
+      if (e < 10000) { e = 10*e + (*p - '0'); }
+      p++;
+    }
+    exponentValid = p > exponentStart;
+    exponent += negativeExponent ? -e : e;
+  }
+
+  // Fast path needs the whole token to be a plain number of few digits
+  if (numDigits > 0 && numDigits <= 19 && exponentValid && p == finish &&
+      digits < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+    double value = (double) digits;
+    value = exponent < 0 ? value / EXACT_POWERS[-exponent] :
+      value * EXACT_POWERS[exponent];
+    return negative ? -value : value;
+  }
+
+  string token(begin,finish);
+  char* last;
+  double value = strtod(token.c_str(),&last);
+  if (last == token.c_str() || *last != '\0') {
+    valid = false;
+  }
+  return value;
+}
+
+/*
+ * Maps the file and reads its meta part.
+ *
+ * @param filename The file to read.
+ */
+CatalogReader :: CatalogReader(string filename) {
+  data = NULL;
+  end = NULL;
+  cursor = NULL;
+  rowsStart = NULL;
+  size = 0;
+  dimension = 0;
+  rowsRead = 0;
+  idColumn = -1;
+  massColumn = -1;
+  this->filename = filename;
+
+  int fd = open(filename.c_str(),O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat info;
+  if (fstat(fd,&info) != 0 || info.st_size == 0) {
+    close(fd);
+    return;
+  }
+
+  void* mapped = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return;
+  }
+  madvise(mapped,info.st_size,MADV_SEQUENTIAL);
+
+  data = (const char*) mapped;
+  size = info.st_size;
+  end = data + size;
+  cursor = data;
+
+  readMeta();
+}
+
+CatalogReader :: ~CatalogReader() {
+  if (data != NULL) {
+    munmap((void*) data,size);
+  }
+}
+
+/*
+ * Finds the next whitespace separated token. Spaces, tabs, newlines and any
+ * other control characters separate tokens.
+ *
+ * @param begin Set to first character of token.
+ * @param finish Set to one past last character of token.
+ * @param limit Where to stop looking, end of file or of a row.
+ * @return If a token was found before limit.
+ */
+bool CatalogReader :: nextToken(const char*& begin, const char*& finish,
+    const char* limit) {
+  const char* p = cursor;
+  while (p < limit && (unsigned char) *p <= ' ') {
+    p++;
+  }
+  if (p == limit) {
+    cursor = p;
+    return false;
+  }
+
+  begin = p;
+  while (p < limit && (unsigned char) *p > ' ') {
+    p++;
+  }
+  finish = p;
+  cursor = p;
+  return true;
+}
+
+/*
+ * Finds the line a character is on, by counting the newlines before it. Only
+ * used to report errors.
+ *
+ * @param p The character.
+ * @return Number of line, starting at 1.
+ */
+int CatalogReader :: lineOf(const char* p) {
+  int line = 1;
+  const char* q = data;
+  while ((q = (const char*) memchr(q,'\n',p - q)) != NULL) {
+    line++;
+    q++;
+  }
+  return line;
+}
+
+/*
+ * Reads the units and header sections, up to and including `#DATA#`, and
+ * finds the columns.
+ */
+void CatalogReader :: readMeta() {
+  const char* begin;
+  const char* finish;
+  bool readUnits = false; // Switch for when inside units part
+  bool readHeader = false; // Switch for when inside header part
+
+  while (nextToken(begin,finish,end)) {
+    string token(begin,finish);
+    if (token == "#DATA#") { break; }
+    else if (token == "#UNITS#") { readUnits = true; }
+    else if (token == "#HEADER#") {
+      readUnits = false;
+      readHeader = true;
+    }
+    else if (readUnits) {
+      if (!units.empty()) { units += " "; }
+      units += token;
+    }
+    else if (readHeader) { columns.push_back(token); }
+  }
+  rowsStart = cursor;
+
+  for (int d = 0; d < 3; d++) {
+    positionColumns[d] = -1;
+    velocityColumns[d] = -1;
+  }
+  for (int c = 0; c < (int) columns.size(); c++) {
+    if (columns[c] == "ObjectId") { idColumn = c; }
+    else if (columns[c] == "m") { massColumn = c; }
+    for (int d = 0; d < 3; d++) {
+      if (columns[c] == POSITION_NAMES[d]) { positionColumns[d] = c; }
+      if (columns[c] == VELOCITY_NAMES[d]) { velocityColumns[d] = c; }
+    }
+  }
+
+  // Coordinates must come as x, x and y, or x, y and z, with velocities
+  while (dimension < 3 && positionColumns[dimension] >= 0 &&
+      velocityColumns[dimension] >= 0) {
+    dimension++;
+  }
+
+  values.resize(columns.size());
+  columnUsed.assign(columns.size(),false);
+  for (int d = 0; d < dimension; d++) {
+    columnUsed[positionColumns[d]] = true;
+    columnUsed[velocityColumns[d]] = true;
+  }
+  if (massColumn >= 0) {
+    columnUsed[massColumn] = true;
+  }
+}
+
+/*
+ * @return If the file was opened and has a header.
+ */
+bool CatalogReader :: good() {
+  return data != NULL && !columns.empty();
+}
+
+/*
+ * @return If the file gives masses.
+ */
+bool CatalogReader :: hasMass() {
+  return massColumn >= 0;
+}
+
+/*
+ * @return Number of coordinates of each object, 0 if none are given.
+ */
+int CatalogReader :: getDimensionality() {
+  return dimension;
+}
+
+/*
+ * @return The units section, words separated by spaces.
+ */
+string CatalogReader :: getUnits() {
+  return units;
+}
+
+/*
+ * Counts the lines after `#DATA#`. Used to size arrays before reading, so
+ * it may count an empty line too many.
+ *
+ * @return Number of rows.
+ */
+int CatalogReader :: countRows() {
+  int rows = 0;
+  const char* p = rowsStart;
+  while (p < end) {
+    const char* newline = (const char*) memchr(p,'\n',end - p);
+    if (newline == NULL) {
+      rows++;
+      break;
+    }
+    if (newline - p > 1) { rows++; }
+    p = newline + 1;
+  }
+  return rows;
+}
+
+/*
+ * Reads the next row. Empty lines are skipped.
+ *
+ * @param id Set to id of object, or its row number if the file has no ids.
+ * @param position Array to store dimensionality coordinates in.
+ * @param velocity Array to store dimensionality velocities in.
+ * @param mass Set to mass, 0 if not given.
+ * @return If a row was read, false at end of file.
+ */
+bool CatalogReader :: nextRow(string& id, double* position, double* velocity,
+    double& mass) {
+  const char* begin;
+  const char* finish;
+
+  // Row is the next line with a token
+  const char* rowEnd;
+  while (true) {
+    if (cursor >= end) {
+      return false;
+    }
+    rowEnd = (const char*) memchr(cursor,'\n',end - cursor);
+    if (rowEnd == NULL) {
+      rowEnd = end;
+    }
+    if (nextToken(begin,finish,rowEnd)) {
+      cursor = begin;
+      break;
+    }
+    cursor = rowEnd < end ? rowEnd + 1 : end;
+  }
+
+  int numColumns = columns.size();
+  for (int c = 0; c < numColumns; c++) {
+    if (!nextToken(begin,finish,rowEnd)) {
+      cout << "Row on line " << lineOf(cursor) << " of " << filename
+        << " has " << c << " values, the header has " << numColumns << "."
+        << endl;
+      exit(1);
+    }
+    if (c == idColumn) {
+      id.assign(begin,finish);
+    } else if (columnUsed[c]) {
+      bool valid = true;
+      values[c] = parseNumber(begin,finish,valid);
+      if (!valid) {
+        cout << "Not a number in column " << columns[c] << " on line "
+          << lineOf(begin) << " of " << filename << ": "
+          << string(begin,finish) << endl;
+        exit(1);
+      }
+    }
+  }
+  if (nextToken(begin,finish,rowEnd)) {
+    cout << "Row on line " << lineOf(begin) << " of " << filename
+      << " has more values than the " << numColumns << " of the header."
+      << endl;
+    exit(1);
+  }
+  cursor = rowEnd < end ? rowEnd + 1 : end;
+
+  rowsRead++;
+  if (idColumn < 0) {
+    id = to_string(rowsRead);
+  }
+
+  for (int d = 0; d < dimension; d++) {
+    position[d] = values[positionColumns[d]];
+    velocity[d] = values[velocityColumns[d]];
+  }
+  mass = massColumn >= 0 ? values[massColumn] : 0;
+  return true;
+}
@@ -0,0 +1,57 @@
+#ifndef CATALOGREADER_HPP
+#define CATALOGREADER_HPP
+
+#include <string>
+#include <vector>
+
+/*
+ * Reads a systemfile or particle catalog. The file is memory mapped and
+ * numbers are parsed in place, so large catalogs load quickly.
+ *
+ * Columns are found by their names in the header section:
+ *   ObjectId, x0 y0 z0 (positions), v0x v0y v0z (velocities), m (mass).
+ * The dimensionality is the number of position columns. Other columns are
+ * skipped, and the mass column may be left out. Without ObjectId, objects
+ * are named by their row number. Each row is one line with a value for every
+ * column. A value that is not a number, or a row with too few or too many
+ * values, is reported with its line and stops the program.
+ */
+class CatalogReader {
+  public:
+    CatalogReader(std::string);
+    ~CatalogReader();
+
+    bool good();
+    bool hasMass();
+    int getDimensionality();
+    int countRows();
+    std::string getUnits();
+
+    bool nextRow(std::string&,double*,double*,double&);
+
+  private:
+    const char* data;                   // Start of mapped file
+    const char* end;                    // One past end of mapped file
+    const char* cursor;                 // Where to read next
+    const char* rowsStart;              // First row after #DATA#
+    size_t size;
+    std::string filename;
+
+    std::string units;
+    std::vector<std::string> columns;
+    std::vector<double> values;         // Numbers of the row being read
+    std::vector<bool> columnUsed;       // If a column is parsed at all
+
+    int dimension;
+    int rowsRead;
+    int idColumn,massColumn;
+    int positionColumns[3],velocityColumns[3];
+
+    void readMeta();
+    bool nextToken(const char*&,const char*&,const char*);
+    int lineOf(const char*);
+};
+
+double parseNumber(const char*,const char*,bool&);
+
+#endif // CATALOGREADER_HPP
@@ -1,62 +1,35 @@
-#include <fstream>
-#include <iostream>
-
 #include "CelestialObject.hpp"
+#include "SolarSystem.hpp"
 
 using namespace std;
 using namespace arma;
 
 /*
- * @param id Short string describing object.
- * @param coors Initial coordinates of celestial object.
- * @param vel Initial velocity of celestial object.
- * @param m Mass of object.
- * @param savefile Path to file where object can store points as calculation is
- * done.
- */
-CelestialObject :: CelestialObject(string id, vec coors, vec vel, double m, string savefile) {
-  this->m = m;
-  this->pos = coors;
-  this->v = vel;
-  this->id = id;
-
-  /*
-   * Open and store datafile. Header is written at once.
-   */
-  datafile = new ofstream(savefile.c_str());
-  *datafile << "Positions for: " << getId() << endl << "#syntax: x y" << endl;
-
-  // Save first point
-  saveCurrentPos();
-}
-
-/*
- * Close datafile
+ * @param system The system the object belongs to.
+ * @param index The index of the object in the system.
  */
-void CelestialObject :: close() {
-  datafile->close();
+template <int D>
+CelestialObject<D> :: CelestialObject(SolarSystem<D>* system, int index) {
+  this->system = system;
+  this->index = index;
 }
 
 /*
  * Set functions
  */
 
-/*
- * Saves the current force exerted on this object.
- *
- * @param newF The force exerted.
- */
-void CelestialObject :: setF(vec newF) {
-  F = newF;
-}
-
 /*
  * Set new positions.
  *
  * @param newPos New position of object.
  */
-void CelestialObject :: setPos(vec newPos) {
-  pos = newPos;
+template <int D>
+void CelestialObject<D> :: setPos(vec::fixed<D> newPos) {
+  for (int d = 0; d < D; d++) {
+    system->pos[d][index] = newPos(d);
+  }
+  system->accelerationsValid = false;
+  system->adaptiveStateValid = false;
 }
 
 /*
@@ -64,19 +37,24 @@ void CelestialObject :: setPos(vec newPos) {
  *
  * @param newVel New velocity of object.
  */
-void CelestialObject :: setV(vec newVel) {
-  v = newVel;
+template <int D>
+void CelestialObject<D> :: setV(vec::fixed<D> newVel) {
+  for (int d = 0; d < D; d++) {
+    system->vel[d][index] = newVel(d);
+  }
+  system->adaptiveStateValid = false;
 }
 
 /*
- * Stores current position to its given savefile.
+ * Changes mass of object.
+ *
+ * @param newMass New mass of object.
  */
-void CelestialObject :: saveCurrentPos() {
-  vec currentPosition = getPos();
-  for (int i = 0; i < currentPosition.n_elem; i++) {
-    *datafile << currentPosition[i] << " ";
-  }
-  *datafile << endl;
+template <int D>
+void CelestialObject<D> :: setM(double newMass) {
+  system->m[index] = newMass;
+  system->accelerationsValid = false;
+  system->adaptiveStateValid = false;
 }
 
 /*
@@ -88,13 +66,66 @@ void CelestialObject :: saveCurrentPos() {
  *
  * @param other The other celestial object to find distance to.
  */
-arma::vec CelestialObject :: getDistTo(CelestialObject other) {
-  vec dist = other.getPos() - getPos();
+template <int D>
+vec::fixed<D> CelestialObject<D> :: getDistTo(CelestialObject<D> other) {
+  vec::fixed<D> dist = other.getPos() - getPos();
   return dist;
 }
 
-double CelestialObject :: getM() { return m; }
-vec CelestialObject :: getPos() { return pos; }
-vec CelestialObject :: getV() { return v; }
-vec CelestialObject :: getForce() { return F; }
-string CelestialObject :: getId() { return id; }
+/*
+ * @return Position of object.
+ */
+template <int D>
+vec::fixed<D> CelestialObject<D> :: getPos() {
+  vec::fixed<D> p;
+  for (int d = 0; d < D; d++) {
+    p(d) = system->pos[d][index];
+  }
+  return p;
+}
+
+/*
+ * @return Velocity of object.
+ */
+template <int D>
+vec::fixed<D> CelestialObject<D> :: getV() {
+  vec::fixed<D> v;
+  for (int d = 0; d < D; d++) {
+    v(d) = system->vel[d][index];
+  }
+  return v;
+}
+
+/*
+ * Accelerations are found again if the last ones were not at the current
+ * positions, as after a Runge-Kutta step, whose last force pass is at a
+ * stage.
+ *
+ * @return Force on object at the current positions.
+ */
+template <int D>
+vec::fixed<D> CelestialObject<D> :: getForce() {
+  if (!system->accelerationsValid) {
+    system->updateAccelerations();
+    system->accelerationsValid = true;
+  }
+
+  vec::fixed<D> F;
+  for (int d = 0; d < D; d++) {
+    F(d) = getM() * system->acc[d][index];
+  }
+  return F;
+}
+
+template <int D>
+double CelestialObject<D> :: getM() { return system->m[index]; }
+template <int D>
+string CelestialObject<D> :: getId() { return system->ids[index]; }
+template <int D>
+int CelestialObject<D> :: getIndex() { return index; }
+
+/*
+ * The dimensionalities supported.
+ */
+template class CelestialObject<2>;
+template class CelestialObject<3>;
@@ -1,30 +1,37 @@
+#ifndef CELESTIALOBJECT_HPP
+#define CELESTIALOBJECT_HPP
+
 #include <string>
 #include <armadillo>
-#include <fstream>
 
+template <int D> class SolarSystem;
+
+/*
+ * A view onto one object in a solar system. The object holds no state itself,
+ * positions, velocities and masses live in the arrays of the system. Views
+ * are therefore cheap to create and copy, and writing through them changes
+ * the system.
+ */
+template <int D>
 class CelestialObject {
   public:
-    CelestialObject(std::string,arma::vec,arma::vec,double,std::string);
+    CelestialObject(SolarSystem<D>*,int);
 
-    arma::vec getDistTo(CelestialObject);
-    arma::vec getPos(),getV(),getForce();
+    arma::vec::fixed<D> getDistTo(CelestialObject<D>);
+    arma::vec::fixed<D> getPos(),getV(),getForce();
 
     std::string getId();
 
     double getM();
+    int getIndex();
 
-    void setF(arma::vec);
-    void setPos(arma::vec);
-    void setV(arma::vec);
-
-    void saveCurrentPos();
-    void close();
+    void setPos(arma::vec::fixed<D>);
+    void setV(arma::vec::fixed<D>);
+    void setM(double);
 
   private:
-    double m;
-
-    arma::vec pos,v,F;
-
-    std::string id;
-    std::ofstream* datafile;
+    SolarSystem<D>* system;
+    int index;
 };
+
+#endif // CELESTIALOBJECT_HPP
@@ -0,0 +1,164 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "ConservationMonitor.hpp"
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Takes the starting values from the system as it is now, and writes the
+ * first line of the log.
+ *
+ * @param system The system to follow.
+ * @param logfilename File to write samples to.
+ * @param sampleEach Steps between samples.
+ * @param maxDrift Relative drift of energy or angular momentum to flag, 0 to
+ * never flag.
+ */
+template <int D>
+ConservationMonitor<D> :: ConservationMonitor(SolarSystem<D>& system,
+    string logfilename, int sampleEach, double maxDrift) {
+  this->system = &system;
+  this->sampleEach = sampleEach > 0 ? sampleEach : 1;
+  this->maxDrift = maxDrift;
+  steps = 0;
+  lastSample = -1;
+  maxEnergyDrift = 0;
+  maxAngularMomentumDrift = 0;
+  maxBarycentreDrift = 0;
+  exceededAt = -1;
+
+  t0 = system.getT();
+  energy0 = system.getEnergy();
+  angularMomentum0 = system.getAngularMomentum();
+  barycentre0 = system.getBarycentre();
+  barycentreV = system.getMomentum() / system.getTotalMass();
+
+  logfile = fopen(logfilename.c_str(),"w");
+  if (logfile == NULL) {
+    cout << "Could not open conservation log: " << logfilename << endl;
+    exit(1);
+  }
+  fprintf(logfile,"# E0 = %.15e |L0| = %.15e\n",energy0,
+      norm(angularMomentum0));
+  fprintf(logfile,"# t dE/|E0| |dL|/|L0| barycentreDrift\n");
+  sample();
+}
+
+template <int D>
+ConservationMonitor<D> :: ~ConservationMonitor() {
+  close();
+}
+
+/*
+ * To be called after every step. Takes a sample every sampleEach calls.
+ *
+ * @return False if the drift has passed the threshold.
+ */
+template <int D>
+bool ConservationMonitor<D> :: check() {
+  steps++;
+  if (steps % sampleEach == 0) {
+    sample();
+  }
+  return exceededAt < 0;
+}
+
+/*
+ * Finds the change of the conserved quantities since the start and writes it
+ * to the log. Energy and angular momentum are relative to their size at the
+ * start, unless that is zero. Barycentre drift is the distance from where
+ * the barycentre would be if it moved with its starting velocity.
+ *
+ * @return False if the drift has passed the threshold.
+ */
+template <int D>
+bool ConservationMonitor<D> :: sample() {
+  if (logfile == NULL || lastSample == steps) {
+    return exceededAt < 0;
+  }
+  lastSample = steps;
+
+  double t = system->getT();
+  double energyScale = energy0 != 0 ? fabs(energy0) : 1;
+  double L0 = norm(angularMomentum0);
+  double angularMomentumScale = L0 > 0 ? L0 : 1;
+
+  double energyDrift = (system->getEnergy() - energy0) / energyScale;
+  double angularMomentumDrift = norm(system->getAngularMomentum() -
+      angularMomentum0) / angularMomentumScale;
+  double barycentreDrift = norm(system->getBarycentre() - barycentre0 -
+      (t - t0) * barycentreV);
+
+  maxEnergyDrift = max(maxEnergyDrift,fabs(energyDrift));
+  maxAngularMomentumDrift = max(maxAngularMomentumDrift,angularMomentumDrift);
+  maxBarycentreDrift = max(maxBarycentreDrift,barycentreDrift);
+
+  fprintf(logfile,"%.9e %.6e %.6e %.6e\n",t,energyDrift,angularMomentumDrift,
+      barycentreDrift);
+
+  if (maxDrift > 0 && exceededAt < 0 && (fabs(energyDrift) > maxDrift ||
+        angularMomentumDrift > maxDrift)) {
+    exceededAt = t;
+    fflush(logfile);
+  }
+
+  return exceededAt < 0;
+}
+
+/*
+ * Samples the last step, if not done, and closes the log.
+ */
+template <int D>
+void ConservationMonitor<D> :: close() {
+  if (logfile == NULL) {
+    return;
+  }
+  sample();
+  fclose(logfile);
+  logfile = NULL;
+}
+
+/*
+ * Get functions
+ */
+
+/*
+ * @return Largest relative change of energy sampled.
+ */
+template <int D>
+double ConservationMonitor<D> :: getMaxEnergyDrift() {
+  return maxEnergyDrift;
+}
+
+/*
+ * @return Largest relative change of angular momentum sampled.
+ */
+template <int D>
+double ConservationMonitor<D> :: getMaxAngularMomentumDrift() {
+  return maxAngularMomentumDrift;
+}
+
+/*
+ * @return Largest barycentre drift sampled.
+ */
+template <int D>
+double ConservationMonitor<D> :: getMaxBarycentreDrift() {
+  return maxBarycentreDrift;
+}
+
+/*
+ * @return Time of the first sample with drift past the threshold, -1 if none.
+ */
+template <int D>
+double ConservationMonitor<D> :: getExceededAt() {
+  return exceededAt;
+}
+
+/*
+ * The dimensionalities supported.
+ */
+template class ConservationMonitor<2>;
+template class ConservationMonitor<3>;
@@ -0,0 +1,53 @@
+#ifndef CONSERVATIONMONITOR_HPP
+#define CONSERVATIONMONITOR_HPP
+
+#include <cstdio>
+#include <string>
+#include <armadillo>
+
+#include "SolarSystem.hpp"
+
+/*
+ * Follows the quantities a closed system conserves: total energy, angular
+ * momentum, and the barycentre moving in a straight line. Samples are taken
+ * every sampleEach steps and written as one line each to a log, holding the
+ * change from the start of the run.
+ *
+ * Energy is taken from the last force pass when that was at the current
+ * positions, so sampling often costs little for the Verlet type schemes.
+ */
+template <int D>
+class ConservationMonitor {
+  public:
+    ConservationMonitor(SolarSystem<D>&,std::string,int,double);
+    ~ConservationMonitor();
+
+    bool check();
+    bool sample();
+    void close();
+
+    double getMaxEnergyDrift();
+    double getMaxAngularMomentumDrift();
+    double getMaxBarycentreDrift();
+    double getExceededAt();
+
+  private:
+    SolarSystem<D>* system;
+    FILE* logfile;                      // NULL when closed
+    int sampleEach;                     // Steps between samples
+    long steps,lastSample;
+    double maxDrift;                    // Relative drift flagged, 0 for none
+
+    /*
+     * Values at the start, and the barycentre velocity from the momentum.
+     */
+    double t0;
+    double energy0;
+    arma::vec::fixed<3> angularMomentum0;
+    arma::vec::fixed<D> barycentre0,barycentreV;
+
+    double maxEnergyDrift,maxAngularMomentumDrift,maxBarycentreDrift;
+    double exceededAt;                  // Time drift passed maxDrift, else -1
+};
+
+#endif // CONSERVATIONMONITOR_HPP
@@ -0,0 +1,192 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <omp.h>
+
+#include "Ensemble.hpp"
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Constants
+ */
+const int ENERGY_SAMPLE_EVERY = 100;    // Steps between energy samples
+
+/*
+ * What is found for each member while it runs.
+ */
+struct MemberSummary {
+  double escapeTime;    // When the object became unbound, -1 if never
+  double minRadius;     // Closest distance to central object
+  double maxRadius;     // Largest distance to central object
+  double energyDrift;   // Largest relative change of total energy
+  long forceEvaluations;
+};
+
+/*
+ * Reads a file listing the members of an ensemble. Same syntax as a
+ * systemfile, each line after `#DATA#` is
+ *
+ *   ObjectId massScale kick dt
+ *
+ * @param ensemblefile The file to read.
+ * @return The members.
+ */
+vector<EnsembleMember> readEnsemble(string ensemblefile) {
+  ifstream datafile(ensemblefile.c_str());
+  if (!datafile.good()) {
+    cout << "Could not open ensemble file: " << ensemblefile << endl;
+    exit(1);
+  }
+
+  string line;
+  while (datafile >> line) {
+    if (strcmp(line.c_str(),"#DATA#") == 0) { break; }
+  }
+
+  vector<EnsembleMember> members;
+  EnsembleMember member;
+  while (datafile >> member.object >> member.massScale >> member.kick
+      >> member.dt) {
+    members.push_back(member);
+  }
+  datafile.close();
+
+  return members;
+}
+
+/*
+ * Runs one member from its own copy of the base system and tracks the
+ * perturbed object relative to the first object, which is taken to be the
+ * central body.
+ *
+ * @param system The perturbed copy of the base system.
+ * @param index Index of perturbed object.
+ * @param dt Step size.
+ * @param T Time to simulate to.
+ * @return Summary of the run.
+ */
+template <int D>
+static MemberSummary runMember(SolarSystem<D>& system, int index, double dt,
+    double T) {
+  MemberSummary summary;
+  summary.escapeTime = -1;
+  summary.minRadius = HUGE_VAL;
+  summary.maxRadius = 0;
+  summary.energyDrift = 0;
+
+  CelestialObject<D> centre = system.getObject(0);
+  CelestialObject<D> object = system.getObject(index);
+  double energy0 = system.getEnergy();
+  double mu = centre.getM() + object.getM();
+
+  // A restarted system goes on from its own time
+  double t = system.getT();
+  long steps = 0;
+  while (t < T) {
+    system.advance(dt);
+    t += dt;
+    steps++;
+
+    vec::fixed<D> r = object.getPos() - centre.getPos();
+    vec::fixed<D> v = object.getV() - centre.getV();
+    double radius = norm(r);
+    summary.minRadius = min(summary.minRadius,radius);
+    summary.maxRadius = max(summary.maxRadius,radius);
+
+    // Unbound when kinetic energy around the centre beats the potential
+    if (summary.escapeTime < 0 && 0.5*dot(v,v) - mu/radius > 0) {
+      summary.escapeTime = t;
+    }
+
+    if (steps % ENERGY_SAMPLE_EVERY == 0 || t >= T) {
+      double drift = fabs((system.getEnergy() - energy0) / energy0);
+      summary.energyDrift = max(summary.energyDrift,drift);
+    }
+  }
+
+  summary.forceEvaluations = system.getNoOfForceEvaluations();
+  return summary;
+}
+
+/*
+ * Runs all members of an ensemble at once, one member per thread. The base
+ * system is read once and copied for each member, so the systemfile is not
+ * parsed again. Nothing but a summary is kept for each member, written as a
+ * line to the output file as soon as the member is done.
+ *
+ * @param base The system every member starts from.
+ * @param members The perturbations.
+ * @param dt Step size of members not giving one.
+ * @param T Time to simulate to.
+ * @param outfile File to write summaries to.
+ */
+template <int D>
+void runEnsemble(SolarSystem<D>& base, vector<EnsembleMember>& members,
+    double dt, double T, string outfile) {
+  int numMembers = members.size();
+
+  // Find perturbed objects before starting
+  vector<int> indices(numMembers,-1);
+  for (int k = 0; k < numMembers; k++) {
+    for (int i = 0; i < base.getNoOfObjects(); i++) {
+      if (base.getObject(i).getId() == members[k].object) {
+        indices[k] = i;
+      }
+    }
+    if (indices[k] < 1) {
+      cout << "Can not perturb object " << members[k].object
+        << ", it must be in the system and not the first." << endl;
+      exit(1);
+    }
+  }
+
+  ofstream output(outfile.c_str());
+  if (!output.good()) {
+    cout << "Could not open ensemble output: " << outfile << endl;
+    exit(1);
+  }
+  output << "#syntax: member object massScale kick dt escapeTime minRadius "
+    << "maxRadius energyDrift forceEvaluations" << endl;
+
+  // Members take different time, so they are handed out one at a time
+  #pragma omp parallel for schedule(dynamic,1)
+  for (int k = 0; k < numMembers; k++) {
+    EnsembleMember& member = members[k];
+    double memberDt = member.dt > 0 ? member.dt : dt;
+
+    SolarSystem<D> system = base;
+    CelestialObject<D> object = system.getObject(indices[k]);
+    object.setM(member.massScale * object.getM());
+    vec::fixed<D> v = object.getV();
+    double speed = norm(v);
+    if (speed > 0) {
+      object.setV(v + (member.kick / speed) * v);
+    }
+
+    MemberSummary summary = runMember(system,indices[k],memberDt,T);
+
+    #pragma omp critical
+    {
+      output << k << " " << member.object << " " << member.massScale << " "
+        << member.kick << " " << memberDt << " " << summary.escapeTime << " "
+        << summary.minRadius << " " << summary.maxRadius << " "
+        << summary.energyDrift << " " << summary.forceEvaluations << endl;
+    }
+  }
+
+  output.close();
+  cout << "Ran " << numMembers << " members on " << omp_get_max_threads()
+    << " threads." << endl;
+}
+
+/*
+ * The dimensionalities supported.
+ */
+template void runEnsemble<2>(SolarSystem<2>&,vector<EnsembleMember>&,double,
+    double,string);
+template void runEnsemble<3>(SolarSystem<3>&,vector<EnsembleMember>&,double,
+    double,string);
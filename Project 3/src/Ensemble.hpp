@@ -0,0 +1,25 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <string>
+#include <vector>
+
+#include "SolarSystem.hpp"
+
+/*
+ * One member of an ensemble, the base system with one object perturbed.
+ */
+struct EnsembleMember {
+  std::string object;   // Id of object perturbed
+  double massScale;     // Factor its mass is scaled by
+  double kick;          // Speed added along its velocity
+  double dt;            // Step size, 0 to use the one given on commandline
+};
+
+std::vector<EnsembleMember> readEnsemble(std::string);
+
+template <int D>
+void runEnsemble(SolarSystem<D>&,std::vector<EnsembleMember>&,double,double,
+    std::string);
+
+#endif // ENSEMBLE_HPP
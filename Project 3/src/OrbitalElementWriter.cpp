@@ -0,0 +1,302 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <unistd.h>
+
+#include "OrbitalElementWriter.hpp"
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Opens the output and writes the elements at the current time. If the
+ * system was restored from a checkpoint with an output sampled alike, that
+ * output is continued from where it was instead, and the statistics are
+ * found again from the samples in it.
+ *
+ * @param system The system to follow.
+ * @param filename File to write elements to.
+ * @param sampleEach Steps between samples.
+ * @param primaryId Id of the object orbited, or "barycentre".
+ * @param statsFilename File to write statistics to when done, empty to keep
+ * none.
+ */
+template <int D>
+OrbitalElementWriter<D> :: OrbitalElementWriter(SolarSystem<D>& system,
+    string filename, int sampleEach, string primaryId, string statsFilename) {
+  this->system = &system;
+  this->sampleEach = sampleEach > 0 ? sampleEach : 1;
+  this->statsFilename = statsFilename;
+  steps = 0;
+  lastSample = -1;
+  numSamples = 0;
+
+  primary = -1;
+  if (primaryId != "barycentre") {
+    for (int i = 0; i < system.getNoOfObjects(); i++) {
+      if (system.getObject(i).getId() == primaryId) {
+        primary = i;
+        break;
+      }
+    }
+    if (primary < 0) {
+      cout << "No object to find orbital elements around: " << primaryId
+        << endl;
+      exit(1);
+    }
+  }
+
+  if (!statsFilename.empty()) {
+    int N = system.getNoOfObjects();
+    numBound.assign(N,0);
+    minA.assign(N,HUGE_VAL); maxA.assign(N,-HUGE_VAL); sumA.assign(N,0);
+    minE.assign(N,HUGE_VAL); maxE.assign(N,-HUGE_VAL); sumE.assign(N,0);
+    minP.assign(N,HUGE_VAL); maxP.assign(N,-HUGE_VAL); sumP.assign(N,0);
+  }
+
+  long bytes,resumeSteps;
+  int resumeEach,resumePrimary;
+  if (system.getElementsOutput(bytes,resumeSteps,resumeEach,resumePrimary) &&
+      resumeEach == this->sampleEach && resumePrimary == primary) {
+    outfile = fopen(filename.c_str(),"r+");
+    if (outfile == NULL || fseek(outfile,0,SEEK_END) != 0 ||
+        ftell(outfile) < bytes || ftruncate(fileno(outfile),bytes) != 0) {
+      cout << "Could not resume orbital element output: " << filename << endl;
+      exit(1);
+    }
+    if (!statsFilename.empty()) {
+      readStatistics(filename);
+    }
+    fseek(outfile,bytes,SEEK_SET);
+
+    // The state at the checkpoint is already sampled, if it was due
+    steps = resumeSteps;
+    lastSample = steps;
+    return;
+  }
+
+  outfile = fopen(filename.c_str(),"w");
+  if (outfile == NULL) {
+    cout << "Could not open orbital element output: " << filename << endl;
+    exit(1);
+  }
+  fprintf(outfile,"#primary: %s\n",primaryId.c_str());
+  fprintf(outfile,"#syntax: t id a e P\n");
+  sample();
+}
+
+template <int D>
+OrbitalElementWriter<D> :: ~OrbitalElementWriter() {
+  close();
+}
+
+/*
+ * To be called after every step. Takes a sample every sampleEach calls.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: check() {
+  steps++;
+  if (steps % sampleEach == 0) {
+    sample();
+  }
+}
+
+/*
+ * Finds the elements of every object but the primary, writes one line for
+ * each, and adds them to the statistics.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: sample() {
+  if (outfile == NULL || lastSample == steps) {
+    return;
+  }
+  lastSample = steps;
+  numSamples++;
+
+  // Position, velocity and mass of what is orbited
+  vec::fixed<D> centre,centreV;
+  double centreM;
+  if (primary < 0) {
+    centreM = system->getTotalMass();
+    centre = system->getBarycentre();
+    centreV = system->getMomentum() / centreM;
+  } else {
+    CelestialObject<D> object = system->getObject(primary);
+    centre = object.getPos();
+    centreV = object.getV();
+    centreM = object.getM();
+  }
+
+  double t = system->getT();
+  for (int i = 0; i < system->getNoOfObjects(); i++) {
+    if (i == primary) {
+      continue;
+    }
+
+    double a,e,P;
+    elements(i,centre,centreV,centreM,a,e,P);
+    fprintf(outfile,"%.9e %s %.9e %.9e %.9e\n",t,
+        system->getObject(i).getId().c_str(),a,e,P);
+
+    if (!statsFilename.empty()) {
+      addToStatistics(i,a,e,P);
+    }
+  }
+}
+
+/*
+ * Adds the elements of one object to its statistics.
+ *
+ * @param i Index of object.
+ * @param a Semi-major axis.
+ * @param e Eccentricity.
+ * @param P Period, -1 if unbound.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: addToStatistics(int i, double a, double e,
+    double P) {
+  minA[i] = min(minA[i],a); maxA[i] = max(maxA[i],a); sumA[i] += a;
+  minE[i] = min(minE[i],e); maxE[i] = max(maxE[i],e); sumE[i] += e;
+  if (P > 0) {
+    numBound[i]++;
+    minP[i] = min(minP[i],P); maxP[i] = max(maxP[i],P); sumP[i] += P;
+  }
+}
+
+/*
+ * Finds the statistics again from the samples in a continued output, so they
+ * cover the whole run. The elements are read as written, to 10 digits.
+ *
+ * @param filename Name of the output, for reports.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: readStatistics(string filename) {
+  map<string,int> index;
+  for (int i = 0; i < system->getNoOfObjects(); i++) {
+    index[system->getObject(i).getId()] = i;
+  }
+  int first = primary == 0 ? 1 : 0;     // A sample starts with this object
+
+  rewind(outfile);
+  char line[1024],id[256];
+  double t,a,e,P;
+  while (fgets(line,sizeof(line),outfile) != NULL) {
+    if (line[0] == '#') {
+      continue;
+    }
+    map<string,int>::iterator found = index.end();
+    if (sscanf(line,"%lf %255s %lf %lf %lf",&t,id,&a,&e,&P) == 5) {
+      found = index.find(id);
+    }
+    if (found == index.end() || found->second == primary) {
+      cout << "Could not read orbital elements to continue statistics from: "
+        << filename << endl;
+      exit(1);
+    }
+
+    if (found->second == first) {
+      numSamples++;
+    }
+    addToStatistics(found->second,a,e,P);
+  }
+}
+
+/*
+ * Osculating elements of one object, from the two body problem of the
+ * object and what it orbits. Masses are in units where G is one.
+ *
+ * @param i Index of object.
+ * @param centre Position of what is orbited.
+ * @param centreV Velocity of what is orbited.
+ * @param centreM Mass of what is orbited.
+ * @param a Set to the semi-major axis, negative if unbound.
+ * @param e Set to the eccentricity.
+ * @param P Set to the period, -1 if unbound.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: elements(int i, vec::fixed<D>& centre,
+    vec::fixed<D>& centreV, double centreM, double& a, double& e, double& P) {
+  CelestialObject<D> object = system->getObject(i);
+  vec::fixed<D> r = object.getPos() - centre;
+  vec::fixed<D> v = object.getV() - centreV;
+
+  // Around the barycentre the object is part of the total mass
+  double mu = primary < 0 ? centreM : centreM + object.getM();
+  double radius = norm(r);
+  double v2 = dot(v,v);
+
+  a = 1.0 / (2.0/radius - v2/mu);
+  vec::fixed<D> eccentricity = ((v2 - mu/radius)*r - dot(r,v)*v) / mu;
+  e = norm(eccentricity);
+  P = a > 0 ? 2*M_PI*sqrt(a*a*a/mu) : -1;
+}
+
+/*
+ * Writes the smallest, largest and mean of each element of each object.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: writeStatistics() {
+  FILE* statsfile = fopen(statsFilename.c_str(),"w");
+  if (statsfile == NULL) {
+    cout << "Could not open orbital element statistics: " << statsFilename
+      << endl;
+    return;
+  }
+
+  fprintf(statsfile,"#syntax: id samples minA maxA meanA minE maxE meanE "
+      "boundSamples minP maxP meanP\n");
+  for (int i = 0; i < system->getNoOfObjects(); i++) {
+    if (i == primary) {
+      continue;
+    }
+    double meanP = numBound[i] > 0 ? sumP[i] / numBound[i] : -1;
+    fprintf(statsfile,"%s %ld %.9e %.9e %.9e %.9e %.9e %.9e %ld %.9e %.9e "
+        "%.9e\n",system->getObject(i).getId().c_str(),numSamples,minA[i],
+        maxA[i],sumA[i] / numSamples,minE[i],maxE[i],sumE[i] / numSamples,
+        numBound[i],numBound[i] > 0 ? minP[i] : -1,
+        numBound[i] > 0 ? maxP[i] : -1,meanP);
+  }
+
+  fclose(statsfile);
+}
+
+/*
+ * Samples the last step, if not done, closes the output and writes the
+ * statistics.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: close() {
+  if (outfile == NULL) {
+    return;
+  }
+  sample();
+  fclose(outfile);
+  outfile = NULL;
+
+  if (!statsFilename.empty()) {
+    writeStatistics();
+  }
+}
+
+/*
+ * Writes what is sampled so far, and hands the point to continue from to the
+ * system, to be stored with its next checkpoint.
+ */
+template <int D>
+void OrbitalElementWriter<D> :: prepareCheckpoint() {
+  if (outfile == NULL) {
+    return;
+  }
+  if (fflush(outfile) != 0) {
+    cout << "Could not write orbital elements." << endl;
+    exit(1);
+  }
+  system->setElementsOutput(ftell(outfile),steps,sampleEach,primary);
+}
+
+/*
+ * The dimensionalities supported.
+ */
+template class OrbitalElementWriter<2>;
+template class OrbitalElementWriter<3>;
@@ -0,0 +1,58 @@
+#ifndef ORBITALELEMENTWRITER_HPP
+#define ORBITALELEMENTWRITER_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <armadillo>
+
+#include "SolarSystem.hpp"
+
+/*
+ * Writes the osculating semi-major axis, eccentricity and period of every
+ * object while the system runs, every sampleEach steps. Elements are of the
+ * two body orbit around a primary object, or around the total mass at the
+ * barycentre. Optionally the smallest, largest and mean of each element is
+ * kept and written when done.
+ *
+ * A system restored from a checkpoint continues the output it had, cut back
+ * to where it was at the checkpoint, if it is sampled alike.
+ */
+template <int D>
+class OrbitalElementWriter {
+  public:
+    OrbitalElementWriter(SolarSystem<D>&,std::string,int,std::string,
+        std::string);
+    ~OrbitalElementWriter();
+
+    void check();
+    void sample();
+    void close();
+    void prepareCheckpoint();
+
+  private:
+    SolarSystem<D>* system;
+    FILE* outfile;                      // NULL when closed
+    int sampleEach;                     // Steps between samples
+    long steps,lastSample;
+    int primary;                        // Index of primary, -1 for barycentre
+
+    /*
+     * Running statistics of each object, empty if not kept. The period is
+     * only counted while the orbit is bound.
+     */
+    std::string statsFilename;
+    long numSamples;
+    std::vector<long> numBound;
+    std::vector<double> minA,maxA,sumA;
+    std::vector<double> minE,maxE,sumE;
+    std::vector<double> minP,maxP,sumP;
+
+    void elements(int,arma::vec::fixed<D>&,arma::vec::fixed<D>&,double,
+        double&,double&,double&);
+    void addToStatistics(int,double,double,double);
+    void readStatistics(std::string);
+    void writeStatistics();
+};
+
+#endif // ORBITALELEMENTWRITER_HPP
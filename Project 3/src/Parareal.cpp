@@ -0,0 +1,222 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <omp.h>
+
+#include "Parareal.hpp"
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Moves a state a number of steps with the scheme set in the system.
+ *
+ * @param system System used to step, its state is overwritten.
+ * @param start State to start from.
+ * @param t Time of start.
+ * @param h Step size.
+ * @param steps Number of steps.
+ * @param end Array the final state is written to.
+ */
+template <int D>
+static void propagate(SolarSystem<D>& system, const double* start, double t,
+    double h, long steps, double* end) {
+  system.setState(start,t);
+  for (long n = 0; n < steps; n++) {
+    system.advance(h);
+  }
+  system.getState(end);
+}
+
+/*
+ * @return Largest change between two states relative to the largest value.
+ */
+static double relativeDefect(const vector<double>& a,
+    const vector<double>& b) {
+  double change = 0;
+  double scale = 0;
+  for (size_t j = 0; j < a.size(); j++) {
+    change = max(change,fabs(a[j] - b[j]));
+    scale = max(scale,fabs(a[j]));
+  }
+  return scale > 0 ? change / scale : change;
+}
+
+/*
+ * Advances the system from its time to T by Parareal, which runs the fine
+ * scheme on all time slices at once.
+ *
+ * The slice ends are first found by a cheap coarse propagator, velocity
+ * Verlet with a large step, run serially. Each iteration then runs the fine
+ * scheme (the one set in the system, RK4 by default) from every slice start
+ * in parallel, and sweeps over the slices correcting the coarse result by
+ * the difference between fine and coarse:
+ *
+ *   U[k+1] = G(U[k]) + F(U_old[k]) - G(U_old[k])
+ *
+ * After iteration i the first i slices are exact, so the fine runs are only
+ * redone from the first slice not yet converged, and the method ends in the
+ * serial fine result after at most one iteration per slice. Iterations stop
+ * when the largest relative change of a slice end is below the tolerance.
+ *
+ * Time spent by the fine runs of the first iteration, which cover the whole
+ * run, is taken as the serial time. The speedup after each iteration is that
+ * over the wall time used so far, and is written to the output file along
+ * with the bound on it if every slice had its own core: serial time over the
+ * coarse runs plus the slowest fine slice of each iteration.
+ *
+ * No trajectory is written. When done the system holds the final state.
+ *
+ * @param system The system to advance.
+ * @param dt Step of the fine scheme.
+ * @param T Time to simulate to.
+ * @param settings Slices, coarse step and tolerance.
+ * @param outfile File to write the defect and speedup of each iteration to.
+ */
+template <int D>
+void runParareal(SolarSystem<D>& system, double dt, double T,
+    PararealSettings settings, string outfile) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  // Steps taken by the serial run, with the same rounding of time
+  long totalSteps = 0;
+  for (double t = system.getT(); t < T; t += dt) {
+    totalSteps++;
+  }
+  int K = (int) min((long) settings.slices,totalSteps);
+  if (K < 1) {
+    cout << "Parareal needs at least one slice and one step." << endl;
+    exit(1);
+  }
+  int maxIterations = settings.maxIterations > 0 ?
+    min(settings.maxIterations,K) : K;
+
+  // Fine steps are split evenly, slices start at the times of the serial run
+  vector<long> firstStep(K+1);
+  vector<double> sliceT(K+1);
+  vector<long> coarseSteps(K);
+  vector<double> coarseH(K);
+  for (int k = 0; k <= K; k++) {
+    firstStep[k] = k*totalSteps / K;
+  }
+  double t = system.getT();
+  for (int k = 0; k < K; k++) {
+    sliceT[k] = t;
+    for (long n = firstStep[k]; n < firstStep[k+1]; n++) {
+      t += dt;
+    }
+  }
+  sliceT[K] = t;
+  for (int k = 0; k < K; k++) {
+    double length = (firstStep[k+1] - firstStep[k])*dt;
+    coarseSteps[k] = max(1L,(long) ceil(length / settings.coarseDt));
+    coarseH[k] = length / coarseSteps[k];
+  }
+
+  ofstream output(outfile.c_str());
+  if (!output.good()) {
+    cout << "Could not open Parareal output: " << outfile << endl;
+    exit(1);
+  }
+  output << "#syntax: iteration defect wallTime speedup speedupBound" << endl;
+
+  int size = system.getStateSize();
+  vector<vector<double> > U(K+1,vector<double>(size));
+  vector<vector<double> > G(K,vector<double>(size));
+  vector<vector<double> > F(K,vector<double>(size));
+  vector<double> next(size);
+  long evaluations0 = system.getNoOfForceEvaluations();
+  long evaluations = 0;
+
+  SolarSystem<D> coarse = system;
+  coarse.setIntegrationMethod(VERLET);
+  system.getState(&U[0][0]);
+  for (int k = 0; k < K; k++) {
+    propagate(coarse,&U[k][0],sliceT[k],coarseH[k],
+        coarseSteps[k],&G[k][0]);
+    U[k+1] = G[k];
+  }
+
+  // Time of the parts that can not overlap, if each slice had its own core
+  double criticalTime = chrono::duration<double>(chrono::steady_clock::now() -
+      start).count();
+  double serialTime = 0;
+  int iteration = 0;
+  double defect = HUGE_VAL;
+  while (iteration < maxIterations && defect >= settings.tolerance) {
+    int first = iteration;
+    iteration++;
+
+    // Fine runs on every slice not yet exact, one slice at a time per thread
+    double fineTime = 0;
+    double slowestSlice = 0;
+    #pragma omp parallel reduction(+:fineTime,evaluations) \
+      reduction(max:slowestSlice)
+    {
+      SolarSystem<D> fine = system;
+      long before = fine.getNoOfForceEvaluations();
+
+      #pragma omp for schedule(dynamic,1)
+      for (int k = first; k < K; k++) {
+        chrono::steady_clock::time_point sliceStart =
+          chrono::steady_clock::now();
+        propagate(fine,&U[k][0],sliceT[k],dt,
+            firstStep[k+1] - firstStep[k],&F[k][0]);
+        double sliceTime = chrono::duration<double>(
+            chrono::steady_clock::now() - sliceStart).count();
+        fineTime += sliceTime;
+        slowestSlice = max(slowestSlice,sliceTime);
+      }
+
+      evaluations += fine.getNoOfForceEvaluations() - before;
+    }
+    if (iteration == 1) {
+      serialTime = fineTime;
+    }
+
+    // The first slice starts from an exact state, so the coarse terms cancel
+    chrono::steady_clock::time_point sweepStart = chrono::steady_clock::now();
+    defect = relativeDefect(F[first],U[first+1]);
+    U[first+1] = F[first];
+    for (int k = first+1; k < K; k++) {
+      propagate(coarse,&U[k][0],sliceT[k],coarseH[k],
+          coarseSteps[k],&next[0]);
+      for (int j = 0; j < size; j++) {
+        double corrected = next[j] + F[k][j] - G[k][j];
+        G[k][j] = next[j];
+        next[j] = corrected;
+      }
+      defect = max(defect,relativeDefect(next,U[k+1]));
+      U[k+1] = next;
+    }
+
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    criticalTime += slowestSlice +
+      chrono::duration<double>(now - sweepStart).count();
+    double wallTime = chrono::duration<double>(now - start).count();
+    output << iteration << " " << defect << " " << wallTime << " "
+      << serialTime / wallTime << " " << serialTime / criticalTime << endl;
+    cout << "Iteration " << iteration << ": defect " << defect << ", speedup "
+      << serialTime / wallTime << " (bound " << serialTime / criticalTime
+      << ")" << endl;
+  }
+  output.close();
+
+  evaluations += coarse.getNoOfForceEvaluations() - evaluations0;
+  system.setState(&U[K][0],sliceT[K]);
+
+  cout << "Parareal used " << iteration << " iterations of " << K
+    << " slices on " << omp_get_max_threads() << " threads, "
+    << evaluations << " force evaluations." << endl;
+}
+
+/*
+ * The dimensionalities supported.
+ */
+template void runParareal<2>(SolarSystem<2>&,double,double,PararealSettings,
+    string);
+template void runParareal<3>(SolarSystem<3>&,double,double,PararealSettings,
+    string);
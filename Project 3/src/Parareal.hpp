@@ -0,0 +1,21 @@
+#ifndef PARAREAL_HPP
+#define PARAREAL_HPP
+
+#include <string>
+
+#include "SolarSystem.hpp"
+
+/*
+ * How a run is split in time and corrected by Parareal.
+ */
+struct PararealSettings {
+  int slices;           // Time slices run in parallel
+  double coarseDt;      // Step of the coarse Verlet propagator
+  double tolerance;     // Relative defect to stop iterating at
+  int maxIterations;    // At most this many, never more than slices, 0 for no cap
+};
+
+template <int D>
+void runParareal(SolarSystem<D>&,double,double,PararealSettings,std::string);
+
+#endif // PARAREAL_HPP
@@ -1,8 +1,11 @@
+#include <cmath>
 #include <iostream>
 #include <armadillo>
 #include <sstream>
+#include <cstdlib>
 
 #include "SolarSystem.hpp"
+#include "CatalogReader.hpp"
 
 using namespace std;
 using namespace arma;
@@ -10,252 +13,860 @@ using namespace arma;
 /*
  * Constants
  */
-const int DIMENSIONALITY = 2;
 const string OBJECTS_DATA_PATH = "../data/objects";
+const string TRAJECTORY_FILE = "trajectory.bin";
+const string PARTICLES_FILE = "particles.bin";
+
+/*
+ * Weights of the velocity Verlet substeps making up one step of the Yoshida
+ * compositions. H. Yoshida, Phys. Lett. A 150 (1990), solution A for sixth
+ * order.
+ */
+const double CBRT2 = 1.259921049894873;
+const double YOSHIDA4_WEIGHTS[3] = {
+  1.0 / (2.0 - CBRT2),
+  -CBRT2 / (2.0 - CBRT2),
+  1.0 / (2.0 - CBRT2)
+};
+const double Y6_W1 = -1.17767998417887;
+const double Y6_W2 = 0.235573213359357;
+const double Y6_W3 = 0.784513610477560;
+const double Y6_W0 = 1.0 - 2.0*(Y6_W1 + Y6_W2 + Y6_W3);
+const double YOSHIDA6_WEIGHTS[7] = {
+  Y6_W3, Y6_W2, Y6_W1, Y6_W0, Y6_W1, Y6_W2, Y6_W3
+};
+
+/*
+ * Constructor for an empty system. Objects can be added, or the system can
+ * be restored from a checkpoint.
+ */
+template <int D>
+SolarSystem<D> :: SolarSystem() {
+  init();
+}
+
+/*
+ * Sets up an empty system at time zero.
+ */
+template <int D>
+void SolarSystem<D> :: init() {
+  t = 0;
+  N = 0;
+  numMassive = 0;
+  method = RK4;
+  forceEvaluations = 0;
+  accelerationsValid = false;
+  potential = 0;
+  potentialValid = false;
+  tolerance = 1e-10;
+  adaptiveStateValid = false;
+  acceptedSteps = 0;
+  rejectedSteps = 0;
+  dpH = 0;
+  trajectory.reset();
+  trajectoryDt = 0;
+  trajectorySaveEach = 1;
+  resumeTrajectory = false;
+  trajectoryBytes = 0;
+  trajectoryFrames = 0;
+  trajectoryCounter = 0;
+  trajectoryFile = "";
+  particleFile = "";
+  restoredFrom = "";
+  particleTrajectory.reset();
+  particleSaveEach = 1;
+  trajectoryParticleSaveEach = 1;
+  particleBytes = 0;
+  particleFrames = 0;
+  particleCounter = 0;
+  elementsBytes = 0;
+  elementsSteps = 0;
+  elementsEach = 0;
+  elementsPrimary = -1;
+}
+
+/*
+ * Reads the header of a systemfile and finds the dimensionality from the
+ * position and velocity columns given.
+ *
+ * @param systemfile The file to read.
+ * @return Number of coordinates of each object, 0 if the file has no header.
+ */
+int readDimensionality(string systemfile) {
+  CatalogReader reader(systemfile);
+  return reader.getDimensionality();
+}
 
 /*
  * Constructor that takes datafile. An already setup system can be read from
  * this file. Assumes file is in a certain syntax. Examples can be found in
- * `data` directory.
+ * `data` directory. The header must name D coordinates, D velocities and the
+ * mass, e.g. `ObjectId x0 y0 z0 v0x v0y v0z m` for D = 3.
  *
- * This function is dependent upon that the dimensionality is set to 2. This is
- * bad.
- * TODO: Refine and make reading independent of dimensions. Maybe take as int
- * arg.
+ * Output is not set up here, see `openTrajectory`.
  *
  * @param systemfile The file to read the system data from.
  */
-SolarSystem :: SolarSystem(string systemfile) {
-  // Values needed to temporary store information from file in
-  ifstream datafile;
-  datafile.open(systemfile.c_str());
-  string line,col,id;
-  bool record = false; // Switch for knowing when past meta part in systemfile
-  double x0,y0,v0x,v0y,m; // For containing the values
-
-  // Procedure for reading the columns line by line
-  while (datafile.good()) {
-    // Wait till past meta header
-    if (!record) {
-      datafile >> line;
-      if (strcmp(line.c_str(),"#DATA#") == 0) { record = true; }
-    } else {
-      // Get the data
-      datafile >> id >> x0 >> y0 >> v0x >> v0y >> m;
-
-      // Check for EOF
-      if (!datafile.good()) { break; }
-
-      // Create temporary vectors for the data (in order to feed to functions)
-      vec position; position << x0 << y0;
-      vec velocity; velocity << v0x << v0y;
-
-      // Create the dynamic file name
-      ostringstream oss;
-      oss << OBJECTS_DATA_PATH << "/" << id << ".dat";
-      string savefile = oss.str();
-
-      // Create the object and store it
-      CelestialObject newObject = CelestialObject(id,position,velocity,m,savefile);
-      addObject(newObject);
-    }
+template <int D>
+SolarSystem<D> :: SolarSystem(string systemfile) {
+  init();
+
+  CatalogReader reader(systemfile);
+  if (!reader.good()) {
+    cout << "Could not read systemfile: " << systemfile << endl;
+    exit(1);
+  }
+  if (reader.getDimensionality() != D || !reader.hasMass()) {
+    cout << "Header of " << systemfile << " does not match " << D
+      << " dimensions." << endl;
+    exit(1);
   }
+  units = reader.getUnits();
+  reserveObjects(reader.countRows());
 
-  // Close the input systemfile
-  datafile.close();
+  // Values needed to temporary store information from file in
+  string id;
+  double position[D],velocity[D];
+  double m;
+
+  while (reader.nextRow(id,position,velocity,m)) {
+    insertObject(numMassive,id,position,velocity,m);
+    numMassive++;
+  }
 }
 
 /*
- * Advances the solar system by a given timestep via the RungeKutta4 scheme.
+ * Advances the solar system by a given timestep, using the scheme set with
+ * `setIntegrationMethod`. Default is RK4.
  *
  * @param dt The timestep to advance.
  */
-void SolarSystem :: advance(double dt) {
-  // Original velocity and position
-  mat pn = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-
-  /*
-   * Matrices used to store the Ks for both acceleration and velocity for all
-   * objects in this system.
-   */
-  mat aK1 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-  mat aK2 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-  mat aK3 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-  mat aK4 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-
-  mat vK1 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-  mat vK2 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-  mat vK3 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-  mat vK4 = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
-
-  // Store first position for last step
-  pn = getAllPositions();
-
-  // K1
-  aK1 = getAllAccelerations();
-  vK1 = getAllVelocities();
-
-  // Update system
-  setAllVelocities( vK1 + 0.5*dt*aK1 );
-  setAllPositions( pn + 0.5*dt*vK1 );
-
-  // K2
-  aK2 = getAllAccelerations();
-  vK2 = getAllVelocities();
-
-  // Update system
-  setAllVelocities( vK1 + 0.5*dt*aK2 );
-  setAllPositions( pn + 0.5*dt*vK2 );
-
-  // K3
-  aK3 = getAllAccelerations();
-  vK3 = getAllVelocities();
-
-  // Update system
-  setAllVelocities( vK1 + dt*aK3 );
-  setAllPositions( pn + dt*vK3 );
-
-  // K4
-  aK4 = getAllAccelerations();
-  vK4 = getAllVelocities();
-
-  // The real step
-  setAllVelocities( vK1 + (1./6) * dt * (aK1 + 2*aK2 + 2*aK3 + aK4) );
-  setAllPositions( pn + (1./6) * dt * (vK1 + 2*vK2 + 2*vK3 + vK4) );
-  
-  // Save positions to files
-  saveAllPositions();
+template <int D>
+void SolarSystem<D> :: advance(double dt) {
+  switch (method) {
+    case RK4:
+    case RK38:
+    case SSPRK3:
+    case RK5:
+      advanceRungeKutta(dt);
+      break;
+    case VERLET:
+      verletStep(dt);
+      break;
+    case YOSHIDA4:
+      advanceComposition(dt,YOSHIDA4_WEIGHTS,3);
+      break;
+    case YOSHIDA6:
+      advanceComposition(dt,YOSHIDA6_WEIGHTS,7);
+      break;
+    case WISDOM_HOLMAN:
+      advanceWisdomHolman(dt);
+      break;
+    case DORMAND_PRINCE:
+      advanceDormandPrince(dt);
+      break;
+  }
 
   // After advance
   t += dt;
+
+  // Save positions to file
+  saveAllPositions();
 }
 
 /*
- * Closes all datafiles.
+ * Advances the system by a composition of velocity Verlet substeps. The
+ * weights are symmetric and sum to one, which gives a symplectic scheme of
+ * higher order. Accelerations at the end of one substep are reused at the
+ * start of the next, so a step costs one force evaluation per weight.
+ *
+ * @param dt The timestep to advance.
+ * @param weights Fraction of dt for each substep.
+ * @param numWeights Number of substeps.
  */
-void SolarSystem :: close() {
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    objects[i].close();
+template <int D>
+void SolarSystem<D> :: advanceComposition(double dt, const double* weights,
+    int numWeights) {
+  for (int k = 0; k < numWeights; k++) {
+    verletStep(weights[k]*dt);
   }
 }
 
 /*
- * Adds a new celestial object to the collection of objects.
+ * Advances the system one step by the velocity Verlet (kick-drift-kick)
+ * scheme, which is symplectic and of second order. Accelerations from the end
+ * of the last step are reused if still valid.
  *
- * @param newObject The new object. Instance of `CelestialObject`.
+ * @param h The timestep to advance.
  */
-void SolarSystem :: addObject(CelestialObject newObject) {
-  objects.push_back(newObject);
+template <int D>
+void SolarSystem<D> :: verletStep(double h) {
+  if (!accelerationsValid) {
+    updateAccelerations();
+  }
+
+  for (int d = 0; d < D; d++) {
+    double* p = &pos[d][0];
+    double* v = &vel[d][0];
+    double* a = &acc[d][0];
+
+    #pragma omp parallel for if (N >= PARALLEL_MIN_OBJECTS)
+    for (int i = 0; i < N; i++) {
+      v[i] += 0.5 * h * a[i];
+      p[i] += h * v[i];
+    }
+  }
+
+  updateAccelerations();
+
+  for (int d = 0; d < D; d++) {
+    double* v = &vel[d][0];
+    double* a = &acc[d][0];
+
+    #pragma omp parallel for if (N >= PARALLEL_MIN_OBJECTS)
+    for (int i = 0; i < N; i++) {
+      v[i] += 0.5 * h * a[i];
+    }
+  }
+
+  accelerationsValid = true;
 }
 
 /*
- * Runs through list of celestial objects and makes all save their current
- * coordinate to their own datafile.
+ * Opens the trajectory file in `OBJECTS_DATA_PATH`, writes its header and
+ * the current positions. Positions are from now on saved after every
+ * advance. Should be called when all objects are added.
+ *
+ * Test particles, if any, are written to their own file, only once per
+ * `particleSaveEach` saved steps.
+ *
+ * If the system was restored from a checkpoint with the same dt, saveEach
+ * and `particleSaveEach`, the trajectories written up to the checkpoint are
+ * continued instead. Otherwise a restored system is a branch of the run that wrote the
+ * checkpoint, and writes to its own files named after the checkpoint, e.g.
+ * `run.trajectory.bin` for `run.chk`, so the files of that run are kept.
+ *
+ * @param dt The timestep the system will be advanced by.
+ * @param saveEach Only every saveEach-th step is saved.
  */
-void SolarSystem :: saveAllPositions() {
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    objects[i].saveCurrentPos();
+template <int D>
+void SolarSystem<D> :: openTrajectory(double dt, int saveEach) {
+  close();
+
+  int numParticles = N - numMassive;
+  bool resume = resumeTrajectory && dt == trajectoryDt &&
+    saveEach == trajectorySaveEach &&
+    (numParticles == 0 || particleSaveEach == trajectoryParticleSaveEach);
+
+  if (!resume) {
+    string prefix = "";
+    if (restoredFrom != "") {
+      // Name of checkpoint without directories and extension
+      size_t start = restoredFrom.find_last_of('/');
+      start = start == string::npos ? 0 : start + 1;
+      size_t end = restoredFrom.find_last_of('.');
+      if (end == string::npos || end <= start) {
+        end = restoredFrom.size();
+      }
+      prefix = restoredFrom.substr(start,end - start) + ".";
+    }
+
+    trajectoryFile = OBJECTS_DATA_PATH + "/" + prefix + TRAJECTORY_FILE;
+    particleFile = OBJECTS_DATA_PATH + "/" + prefix + PARTICLES_FILE;
+    if (restoredFrom != "") {
+      cout << "Branching from " << restoredFrom << ", trajectory is written "
+        << "to " << trajectoryFile << endl;
+    }
   }
+
+  trajectory.reset(new TrajectoryWriter(trajectoryFile,D,saveEach));
+
+  if (numParticles > 0) {
+    particleTrajectory.reset(new TrajectoryWriter(particleFile,D,
+        saveEach*particleSaveEach));
+  }
+
+  if (resume) {
+    trajectory->resume(numMassive,trajectoryBytes,trajectoryFrames,
+        trajectoryCounter);
+    if (particleTrajectory != NULL) {
+      particleTrajectory->resume(numParticles,particleBytes,particleFrames,
+          particleCounter);
+    }
+  } else {
+    vector<string> massiveIds(ids.begin(),ids.begin() + numMassive);
+    vector<double> masses(m.begin(),m.begin() + numMassive);
+    trajectory->writeHeader(massiveIds,masses,units,dt);
+
+    if (particleTrajectory != NULL) {
+      vector<string> particleIds(ids.begin() + numMassive,ids.end());
+      vector<double> zeroMasses(numParticles,0);
+      particleTrajectory->writeHeader(particleIds,zeroMasses,units,dt);
+    }
+
+    // Save first point
+    saveAllPositions();
+  }
+
+  trajectoryDt = dt;
+  trajectorySaveEach = saveEach;
+  trajectoryParticleSaveEach = particleSaveEach;
+  resumeTrajectory = false;
 }
 
 /*
- * Get functions
+ * Writes what is left of the trajectories and closes the files.
  */
+template <int D>
+void SolarSystem<D> :: close() {
+  trajectory.reset();
+  particleTrajectory.reset();
+}
 
 /*
- * @return All velocities as arma matrix.
+ * Adds a new celestial object to the system. Its state is put after the
+ * other massive objects in the state arrays, before any test particles.
+ *
+ * @param id Short string describing object.
+ * @param position Initial coordinates of celestial object.
+ * @param velocity Initial velocity of celestial object.
+ * @param mass Mass of object.
  */
-mat SolarSystem :: getAllVelocities() {
-  mat v = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
+template <int D>
+void SolarSystem<D> :: addObject(string id, vec::fixed<D> position,
+    vec::fixed<D> velocity, double mass) {
+  insertObject(numMassive,id,position.memptr(),velocity.memptr(),mass);
+  numMassive++;
+}
 
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    v.col(i) = objects[i].getV();
+/*
+ * Adds a massless test particle to the system. Its state is appended to the
+ * state arrays.
+ *
+ * @param id Short string describing particle.
+ * @param position Initial coordinates of particle.
+ * @param velocity Initial velocity of particle.
+ */
+template <int D>
+void SolarSystem<D> :: addTestParticle(string id, vec::fixed<D> position,
+    vec::fixed<D> velocity) {
+  insertObject(N,id,position.memptr(),velocity.memptr(),0);
+}
+
+/*
+ * Adds test particles read from a file. The syntax is that of a systemfile,
+ * the mass column may be left out and is not used.
+ *
+ * @param particlefile The file to read the particles from.
+ */
+template <int D>
+void SolarSystem<D> :: addTestParticles(string particlefile) {
+  CatalogReader reader(particlefile);
+  if (!reader.good()) {
+    cout << "Could not read particle file: " << particlefile << endl;
+    exit(1);
+  }
+  if (reader.getDimensionality() != D) {
+    cout << "Header of " << particlefile << " does not match " << D
+      << " dimensions." << endl;
+    exit(1);
   }
+  reserveObjects(N + reader.countRows());
 
-  return v;
+  string id;
+  double position[D],velocity[D];
+  double mass;
+
+  while (reader.nextRow(id,position,velocity,mass)) {
+    insertObject(N,id,position,velocity,0);
+  }
 }
 
 /*
- * @return All positions as arma matrix.
+ * Makes room in all arrays for a number of objects, so adding many objects
+ * does not move the arrays again and again.
+ *
+ * @param capacity Number of objects and particles to make room for.
  */
-mat SolarSystem :: getAllPositions() {
-  mat p = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
+template <int D>
+void SolarSystem<D> :: reserveObjects(int capacity) {
+  for (int d = 0; d < D; d++) {
+    pos[d].reserve(capacity);
+    vel[d].reserve(capacity);
+    acc[d].reserve(capacity);
+    pos0[d].reserve(capacity);
+    vel0[d].reserve(capacity);
+  }
+  m.reserve(capacity);
+  ids.reserve(capacity);
+}
 
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    p.col(i) = objects[i].getPos();
+/*
+ * Puts a new object at the given index of the state arrays.
+ *
+ * @param index Where to put the object.
+ * @param id Short string describing object.
+ * @param position Initial coordinates of object.
+ * @param velocity Initial velocity of object.
+ * @param mass Mass of object.
+ */
+template <int D>
+void SolarSystem<D> :: insertObject(int index, const string& id,
+    const double* position, const double* velocity, double mass) {
+  for (int d = 0; d < D; d++) {
+    pos[d].insert(pos[d].begin() + index,position[d]);
+    vel[d].insert(vel[d].begin() + index,velocity[d]);
+    acc[d].insert(acc[d].begin() + index,0);
+
+    pos0[d].push_back(0);
+    vel0[d].push_back(0);
   }
+  m.insert(m.begin() + index,mass);
+  ids.insert(ids.begin() + index,id);
+  accelerationsValid = false;
+  adaptiveStateValid = false;
+
+  N++;
+}
 
-  return p;
+/*
+ * Sets the scheme used by `advance`. Changing scheme throws away the state of
+ * the adaptive scheme, so its stages and step size are not reused later.
+ *
+ * @param newMethod The scheme to use.
+ */
+template <int D>
+void SolarSystem<D> :: setIntegrationMethod(IntegrationMethod newMethod) {
+  if (newMethod != method) {
+    adaptiveStateValid = false;
+  }
+  method = newMethod;
 }
 
 /*
- * @return All current accelerations as arma matrix.
+ * Sets the error tolerance per step of the adaptive scheme. It is used both
+ * as absolute and relative tolerance.
+ *
+ * @param newTolerance The tolerance.
  */
-mat SolarSystem :: getAllAccelerations() {
-  mat a = zeros<mat>(DIMENSIONALITY,getNoOfObjects());
+template <int D>
+void SolarSystem<D> :: setTolerance(double newTolerance) {
+  tolerance = newTolerance;
+}
 
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    a.col(i) = getForces(objects[i]) / objects[i].getM();
+/*
+ * Gives the current coordinates of all objects to the trajectory writers, if
+ * output is opened. The writers copy them and write in the background.
+ */
+template <int D>
+void SolarSystem<D> :: saveAllPositions() {
+  if (trajectory != NULL) {
+    trajectory->addFrame(t,pos,0,numMassive);
+  }
+  if (particleTrajectory != NULL) {
+    particleTrajectory->addFrame(t,pos,numMassive,N - numMassive);
   }
+}
 
-  return a;
+/*
+ * Sets how seldom test particles are saved.
+ *
+ * @param newSaveEach Particles are saved once per this many saved steps.
+ */
+template <int D>
+void SolarSystem<D> :: setParticleSaveEach(int newSaveEach) {
+  particleSaveEach = newSaveEach > 0 ? newSaveEach : 1;
+}
+
+/*
+ * Sets where an orbital element output kept beside the system is to be
+ * continued from. Stored with the next checkpoint, so a restart can carry on
+ * the output instead of writing it anew.
+ *
+ * @param bytes Size of the output, 0 if there is none.
+ * @param steps Steps taken by the output when it had that size.
+ * @param sampleEach Steps between its samples.
+ * @param primary Index of the object orbited, -1 for the barycentre.
+ */
+template <int D>
+void SolarSystem<D> :: setElementsOutput(long bytes, long steps,
+    int sampleEach, int primary) {
+  elementsBytes = bytes;
+  elementsSteps = steps;
+  elementsEach = sampleEach;
+  elementsPrimary = primary;
 }
 
 /*
- * Set methods
+ * Gets what was given to `setElementsOutput` before the checkpoint this
+ * system was restored from.
+ *
+ * @return If there is an output to continue.
  */
+template <int D>
+bool SolarSystem<D> :: getElementsOutput(long& bytes, long& steps,
+    int& sampleEach, int& primary) {
+  bytes = elementsBytes;
+  steps = elementsSteps;
+  sampleEach = elementsEach;
+  primary = elementsPrimary;
+  return elementsBytes > 0;
+}
 
 /*
- * Set velocity of all objects
+ * Finds the acceleration of every object from the gravity of all other
+ * objects in the system, and stores it in the acceleration arrays.
+ *
+ * Each pair is visited once. By Newton's third law the pull on j from i is
+ * opposite to the pull on i from j, so both are found from the same distance
+ * and the same 1/r^3. Accumulates for object i in locals so the inner loop
+ * only streams through the arrays of the other objects.
  *
- * @param velocities Arma matrix containing all velocities as columns.
+ * The potential energy is summed from the same distances, so the energy at
+ * positions where forces were found costs no extra pass over the pairs.
+ *
+ * Only the massive objects are paired. Test particles are done after, by
+ * `particleAccelerations`.
  */
-void SolarSystem :: setAllVelocities(mat velocities) {
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    objects[i].setV(velocities.col(i));
+template <int D>
+void SolarSystem<D> :: updateAccelerations() {
+  double r[D],a_i[D];
+  double u = 0;
+  forceEvaluations++;
+
+  for (int d = 0; d < D; d++) {
+    for (int i = 0; i < numMassive; i++) {
+      acc[d][i] = 0;
+    }
+  }
+
+  for (int i = 0; i < numMassive; i++) {
+    for (int d = 0; d < D; d++) {
+      a_i[d] = 0;
+    }
+
+    for (int j = i+1; j < numMassive; j++) {
+      double dist2 = 0;
+      for (int d = 0; d < D; d++) {
+        r[d] = pos[d][j] - pos[d][i];
+        dist2 += r[d]*r[d];
+      }
+      double invDist3 = 1.0 / (dist2*sqrt(dist2));
+      double factor_i = m[j] * invDist3;
+      double factor_j = m[i] * invDist3;
+      u -= factor_j * m[j] * dist2;
+
+      for (int d = 0; d < D; d++) {
+        a_i[d] += r[d] * factor_i;
+        acc[d][j] -= r[d] * factor_j;
+      }
+    }
+
+    for (int d = 0; d < D; d++) {
+      acc[d][i] += a_i[d];
+    }
+  }
+
+  potential = u;
+  potentialValid = true;
+
+  if (N > numMassive) {
+    particleAccelerations();
   }
 }
 
 /*
- * Set position of all objects
+ * Finds the acceleration of every test particle from the gravity of the
+ * massive objects.
  *
- * @param positions Arma matrix containing all positions as columns.
+ * Particles are split in blocks small enough to stay in cache, and blocks
+ * are shared among threads. Within a block the massive objects are the outer
+ * loop, so the inner loop runs over particles in contiguous arrays with no
+ * dependencies between iterations, and is vectorized.
  */
-void SolarSystem :: setAllPositions(mat positions) {
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    objects[i].setPos(positions.col(i));
+template <int D>
+void SolarSystem<D> :: particleAccelerations() {
+  double* p[D];
+  double* a[D];
+  for (int d = 0; d < D; d++) {
+    p[d] = &pos[d][0];
+    a[d] = &acc[d][0];
+  }
+  const double* mass = &m[0];
+  int numObjects = N;
+  int massive = numMassive;
+
+  #pragma omp parallel for schedule(static) if (N - numMassive >= PARALLEL_MIN_OBJECTS)
+  for (int start = massive; start < numObjects; start += PARTICLE_BLOCK) {
+    int end = min(start + PARTICLE_BLOCK,numObjects);
+
+    for (int d = 0; d < D; d++) {
+      for (int j = start; j < end; j++) {
+        a[d][j] = 0;
+      }
+    }
+
+    for (int i = 0; i < massive; i++) {
+      double p_i[D];
+      for (int d = 0; d < D; d++) {
+        p_i[d] = p[d][i];
+      }
+      double m_i = mass[i];
+
+      #pragma omp simd
+      for (int j = start; j < end; j++) {
+        double r[D];
+        double dist2 = 0;
+        for (int d = 0; d < D; d++) {
+          r[d] = p_i[d] - p[d][j];
+          dist2 += r[d]*r[d];
+        }
+        double factor = m_i / (dist2*sqrt(dist2));
+
+        for (int d = 0; d < D; d++) {
+          a[d][j] += r[d] * factor;
+        }
+      }
+    }
   }
 }
 
 /*
- * Returns a double representing the total force working on this object from
- * all other objects in the system.
+ * Replaces positions and velocities of all objects, e.g. to start a time
+ * slice from a given state.
+ *
+ * @param y Array of length `getStateSize`, as filled by `getState`.
+ * @param newT Time of the state.
  */
-vec SolarSystem :: getForces(CelestialObject object) {
-  vec force = zeros(DIMENSIONALITY); vec r;
+template <int D>
+void SolarSystem<D> :: setState(const double* y, double newT) {
+  unpackState(y);
+  t = newT;
+  accelerationsValid = false;
+  adaptiveStateValid = false;
+}
 
-  for (int i = 0; i < getNoOfObjects(); i++) {
-    // Not find force from itself
-    if (strcmp(objects[i].getId().c_str(),object.getId().c_str()) == 0) { continue; }
+/*
+ * Copies positions and velocities of all objects into one array, all
+ * positions first.
+ *
+ * @param y Array of length `getStateSize`.
+ */
+template <int D>
+void SolarSystem<D> :: getState(double* y) {
+  packState(y);
+}
 
-    // Gravitational force
-    r = object.getDistTo(objects[i]);
-    force += r * objects[i].getM()*object.getM() / pow(norm(r,2),3);
-  }
+/*
+ * Get functions
+ */
 
-  return force;
+/*
+ * @param i Index of object.
+ *
+ * @return View onto object with given index.
+ */
+template <int D>
+CelestialObject<D> SolarSystem<D> :: getObject(int i) {
+  return CelestialObject<D>(this,i);
 }
 
 /*
- * @return The number of objects in the system.
+ * @return The number of objects in the system, test particles included.
  */
-int SolarSystem :: getNoOfObjects() {
-  return objects.size();
+template <int D>
+int SolarSystem<D> :: getNoOfObjects() {
+  return N;
 }
 
+/*
+ * @return The number of test particles in the system.
+ */
+template <int D>
+int SolarSystem<D> :: getNoOfParticles() {
+  return N - numMassive;
+}
+
+/*
+ * @return Number of values in the state given by `getState`.
+ */
+template <int D>
+int SolarSystem<D> :: getStateSize() {
+  return 2*D*N;
+}
+
+/*
+ * @return How many times the accelerations have been found. The cost of the
+ * simulation is almost all in these.
+ */
+template <int D>
+long SolarSystem<D> :: getNoOfForceEvaluations() {
+  return forceEvaluations;
+}
+
+/*
+ * @return Number of steps accepted and rejected by the adaptive scheme.
+ */
+template <int D>
+long SolarSystem<D> :: getNoOfAcceptedSteps() { return acceptedSteps; }
+template <int D>
+long SolarSystem<D> :: getNoOfRejectedSteps() { return rejectedSteps; }
+
 /*
  * @return The current time the system is in.
  */
-double SolarSystem :: getT() {
+template <int D>
+double SolarSystem<D> :: getT() {
   return t;
 }
+
+/*
+ * Finds the total energy, kinetic plus potential, of the system. Masses are
+ * in units where G is one.
+ *
+ * @return The total energy.
+ */
+template <int D>
+double SolarSystem<D> :: getEnergy() {
+  return getKineticEnergy() + getPotentialEnergy();
+}
+
+/*
+ * @return The kinetic energy of the system.
+ */
+template <int D>
+double SolarSystem<D> :: getKineticEnergy() {
+  double energy = 0;
+
+  // Test particles have no mass, so add nothing
+  for (int i = 0; i < numMassive; i++) {
+    double v2 = 0;
+    for (int d = 0; d < D; d++) {
+      v2 += vel[d][i]*vel[d][i];
+    }
+    energy += 0.5 * m[i] * v2;
+  }
+
+  return energy;
+}
+
+/*
+ * Gives the potential energy of the system. If the last force pass was at
+ * the current positions its sum is used, else the pairs are visited again.
+ *
+ * @return The potential energy.
+ */
+template <int D>
+double SolarSystem<D> :: getPotentialEnergy() {
+  if (accelerationsValid && potentialValid) {
+    return potential;
+  }
+
+  double energy = 0;
+  for (int i = 0; i < numMassive; i++) {
+    for (int j = i+1; j < numMassive; j++) {
+      double dist2 = 0;
+      for (int d = 0; d < D; d++) {
+        double r = pos[d][j] - pos[d][i];
+        dist2 += r*r;
+      }
+      energy -= m[i] * m[j] / sqrt(dist2);
+    }
+  }
+
+  return energy;
+}
+
+/*
+ * Finds the total angular momentum about the origin. In two dimensions only
+ * the third component is nonzero.
+ *
+ * @return The angular momentum.
+ */
+template <int D>
+vec::fixed<3> SolarSystem<D> :: getAngularMomentum() {
+  vec::fixed<3> L;
+  L.zeros();
+
+  for (int i = 0; i < numMassive; i++) {
+    double r[3] = {0, 0, 0};
+    double p[3] = {0, 0, 0};
+    for (int d = 0; d < D; d++) {
+      r[d] = pos[d][i];
+      p[d] = m[i] * vel[d][i];
+    }
+    L(0) += r[1]*p[2] - r[2]*p[1];
+    L(1) += r[2]*p[0] - r[0]*p[2];
+    L(2) += r[0]*p[1] - r[1]*p[0];
+  }
+
+  return L;
+}
+
+/*
+ * @return The total momentum of the system.
+ */
+template <int D>
+vec::fixed<D> SolarSystem<D> :: getMomentum() {
+  vec::fixed<D> P;
+  P.zeros();
+
+  for (int i = 0; i < numMassive; i++) {
+    for (int d = 0; d < D; d++) {
+      P(d) += m[i] * vel[d][i];
+    }
+  }
+
+  return P;
+}
+
+/*
+ * @return The centre of mass of the system.
+ */
+template <int D>
+vec::fixed<D> SolarSystem<D> :: getBarycentre() {
+  vec::fixed<D> R;
+  R.zeros();
+
+  for (int i = 0; i < numMassive; i++) {
+    for (int d = 0; d < D; d++) {
+      R(d) += m[i] * pos[d][i];
+    }
+  }
+
+  return R / getTotalMass();
+}
+
+/*
+ * @return The sum of the masses of all objects.
+ */
+template <int D>
+double SolarSystem<D> :: getTotalMass() {
+  double mass = 0;
+  for (int i = 0; i < numMassive; i++) {
+    mass += m[i];
+  }
+  return mass;
+}
+
+/*
+ * @return The scheme used by `advance`.
+ */
+template <int D>
+IntegrationMethod SolarSystem<D> :: getIntegrationMethod() {
+  return method;
+}
+
+/*
+ * @return The error tolerance of the adaptive scheme.
+ */
+template <int D>
+double SolarSystem<D> :: getTolerance() {
+  return tolerance;
+}
+
+/*
+ * The dimensionalities supported.
+ */
+template class SolarSystem<2>;
+template class SolarSystem<3>;
@@ -1,31 +1,202 @@
+#ifndef SOLARSYSTEM_HPP
+#define SOLARSYSTEM_HPP
+
 #include <vector>
+#include <memory>
+#include <fstream>
+#include <type_traits>
 #include <armadillo>
 
 #include "CelestialObject.hpp"
+#include "TrajectoryWriter.hpp"
+
+/*
+ * Constants
+ */
+const int PARALLEL_MIN_OBJECTS = 4096;  // Loops over fewer run serially
+const int PARTICLE_BLOCK = 512;         // Test particles per block of work
+const int RK_MAX_STAGES = 6;            // Of the explicit Runge-Kutta schemes
+
+/*
+ * Schemes the system can be advanced by.
+ */
+enum IntegrationMethod { RK4, VERLET, YOSHIDA4, YOSHIDA6, WISDOM_HOLMAN,
+  DORMAND_PRINCE, RK38, SSPRK3, RK5 };
+
+/*
+ * Reads the header of a systemfile and gives the number of coordinates each
+ * object has.
+ */
+int readDimensionality(std::string);
+
+/*
+ * Reads the number of coordinates each object has from a checkpoint.
+ */
+int readCheckpointDimensionality(std::string);
 
+/*
+ * Owns a trajectory writer of a system. A copy of a system must not write to
+ * the files of the original, so a copied handle is empty, and assigning one
+ * closes the writer held before. Moving passes the writer on.
+ */
+class WriterHandle : public std::unique_ptr<TrajectoryWriter> {
+  public:
+    WriterHandle() {}
+    WriterHandle(const WriterHandle&) {}
+    WriterHandle(WriterHandle&&) = default;
+    WriterHandle& operator=(const WriterHandle&) { reset(); return *this; }
+    WriterHandle& operator=(WriterHandle&&) = default;
+};
+
+/*
+ * A system of objects moving under their mutual gravity, in D dimensions.
+ * Implemented for D = 2 and D = 3.
+ *
+ * Test particles feel the gravity of the objects but have no mass, so they
+ * pull on nothing. They are stored after the massive objects, so the
+ * integrators move them along with the rest, while forces cost only the
+ * number of massive objects times the number of particles.
+ */
+template <int D>
 class SolarSystem {
   public:
+    SolarSystem();
     SolarSystem(std::string);
 
-    void addObject(CelestialObject);
+    void addObject(std::string,arma::vec::fixed<D>,arma::vec::fixed<D>,double);
+    void addTestParticle(std::string,arma::vec::fixed<D>,arma::vec::fixed<D>);
+    void addTestParticles(std::string);
     void advance(double);
+    void openTrajectory(double,int);
     void close();
+    void writeCheckpoint(std::string);
+    void readCheckpoint(std::string);
+    void setIntegrationMethod(IntegrationMethod);
+    void setTolerance(double);
+    void setParticleSaveEach(int);
+    void setElementsOutput(long,long,int,int);
+    bool getElementsOutput(long&,long&,int&,int&);
+    void setState(const double*,double);
+    void getState(double*);
+
+    CelestialObject<D> getObject(int);
 
     int getNoOfObjects();
+    int getNoOfParticles();
+    int getStateSize();
+    long getNoOfForceEvaluations();
+    long getNoOfAcceptedSteps(),getNoOfRejectedSteps();
     double getT();
+    double getEnergy();
+    double getKineticEnergy();
+    double getPotentialEnergy();
+    arma::vec::fixed<3> getAngularMomentum();
+    arma::vec::fixed<D> getMomentum();
+    arma::vec::fixed<D> getBarycentre();
+    double getTotalMass();
+    IntegrationMethod getIntegrationMethod();
+    double getTolerance();
 
   private:
+    friend class CelestialObject<D>;
+
     double t;
+    int N;                              // Number of objects and particles
+    int numMassive;                     // Objects before the particles
+
+    IntegrationMethod method;
+    long forceEvaluations;              // Times accelerations are found
+    bool accelerationsValid;            // If acc belongs to current positions
+    double potential;                   // Potential energy from last force pass
+    bool potentialValid;                // If potential belongs to acc
+
+    /*
+     * State of the adaptive integrator. It runs ahead of t, the state arrays
+     * are found from it by dense output. Arrays are only sized when the
+     * adaptive integrator is used.
+     */
+    double tolerance;                   // Error tolerance per step
+    bool adaptiveStateValid;            // If state below belongs to system
+    long acceptedSteps,rejectedSteps;
+    double dpT,dpH,dpTOld,dpHOld;       // Time, next step and last step
+    std::vector<double> dpY,dpYNew;     // State at dpT and trial state
+    std::vector<double> dpK[7];         // Stages of last step
+    std::vector<double> dpCont[5];      // Dense output coefficients
+
+    /*
+     * State of all objects as structure of arrays. Component d of object i is
+     * found at pos[d][i]. The integrator works on these in place.
+     */
+    std::vector<double> pos[D],vel[D];
+    std::vector<double> acc[D];
+    std::vector<double> m;
+    std::vector<std::string> ids;
+    std::string units;                  // Units section of systemfile
 
-    std::vector<CelestialObject> objects;
+    WriterHandle trajectory;            // Empty until output is opened
 
-    arma::vec getForces(CelestialObject);
+    /*
+     * Trajectory settings, and where to continue it after a restart.
+     */
+    double trajectoryDt;
+    int trajectorySaveEach;
+    bool resumeTrajectory;              // If restored from a checkpoint
+    long trajectoryBytes,trajectoryFrames,trajectoryCounter;
+    std::string trajectoryFile,particleFile; // Paths, empty until opened
+    std::string restoredFrom;           // Checkpoint read, empty if none
 
-    arma::mat getAllVelocities();
-    arma::mat getAllPositions();
-    arma::mat getAllAccelerations();
+    /*
+     * Test particles are written to their own file, less often.
+     */
+    WriterHandle particleTrajectory;
+    int particleSaveEach;               // Saved once per this many frames
+    int trajectoryParticleSaveEach;     // The one the particle file has
+    long particleBytes,particleFrames,particleCounter;
 
-    void setAllVelocities(arma::mat);
-    void setAllPositions(arma::mat);
+    /*
+     * Where an orbital element output is to be continued from after a
+     * restart, see `setElementsOutput`.
+     */
+    long elementsBytes,elementsSteps;   // Bytes is 0 if there is none
+    int elementsEach,elementsPrimary;
+
+    /*
+     * Scratch arrays for the integrators, sized once when objects are added.
+     */
+    std::vector<double> pos0[D],vel0[D];
+
+    /*
+     * Velocities and accelerations at each stage of the explicit Runge-Kutta
+     * schemes. Sized when a scheme is first used.
+     */
+    std::vector<double> stageV[RK_MAX_STAGES][D],stageA[RK_MAX_STAGES][D];
+
+    void init();
+    void reserveObjects(int);
+    void insertObject(int,const std::string&,const double*,const double*,
+        double);
+    void advanceRungeKutta(double);
+    template <class Tableau> void advanceExplicitRK(double);
+    template <class Tableau, int s>
+      typename std::enable_if<(s < Tableau::stages)>::type
+      explicitRKStage(double);
+    template <class Tableau, int s>
+      typename std::enable_if<(s == Tableau::stages)>::type
+      explicitRKStage(double);
+    void resizeStages(int);
+    void advanceComposition(double,const double*,int);
+    void verletStep(double);
+    void advanceWisdomHolman(double);
+    void advanceDormandPrince(double);
+    void resizeAdaptiveState();
+    void derivatives(const double*,double*);
+    void packState(double*);
+    void unpackState(const double*);
+    void interactionKick(double);
+    void sunDrift(double);
+    void updateAccelerations();
+    void particleAccelerations();
     void saveAllPositions();
 };
+
+#endif // SOLARSYSTEM_HPP
@@ -0,0 +1,357 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "SolarSystem.hpp"
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Constants
+ */
+
+/*
+ * Identifies a checkpoint. The last two characters are the version of the
+ * layout, and must be bumped whenever the layout changes.
+ */
+const char CHECKPOINT_MAGIC[8] = {'S','S','C','H','K','P','0','5'};
+
+/*
+ * Fixed size start of a checkpoint. It is followed by the units string, the
+ * paths of the trajectory and particle files, the ids, and then the arrays: masses, positions, velocities and accelerations
+ * (N values for each component), and the state of the adaptive integrator
+ * if it is in use (2*D*N values for dpY, each of dpK and each of dpCont).
+ */
+struct CheckpointHeader {
+  char magic[8];
+  int dimension;
+  int numObjects;
+  int numMassive;
+  int method;
+  int accelerationsValid;
+  int adaptiveStateValid;
+  int unitsLength;
+  double t;
+  double tolerance;
+  double dpT,dpH,dpTOld,dpHOld;
+  long forceEvaluations;
+  long acceptedSteps,rejectedSteps;
+
+  // Where the trajectory file is to be continued from
+  int trajectorySaveEach;
+  double trajectoryDt;
+  long trajectoryBytes,trajectoryFrames,trajectoryCounter;
+  int particleSaveEach;
+  long particleBytes,particleFrames,particleCounter;
+
+  // Where the orbital element output is to be continued from
+  long elementsBytes,elementsSteps;
+  int elementsEach,elementsPrimary;
+};
+
+/*
+ * Writes values to file.
+ *
+ * @return If all values were written.
+ */
+static bool writeValues(FILE* outfile, const double* values, int n) {
+  return fwrite(values,sizeof(double),n,outfile) == (size_t) n;
+}
+
+/*
+ * Reads values from file.
+ *
+ * @return If all values were read.
+ */
+static bool readValues(FILE* infile, double* values, int n) {
+  return fread(values,sizeof(double),n,infile) == (size_t) n;
+}
+
+/*
+ * Writes a string as its length followed by the characters.
+ *
+ * @return If the string was written.
+ */
+static bool writeString(FILE* outfile, const string& str) {
+  int length = str.size();
+  return fwrite(&length,sizeof(int),1,outfile) == 1 &&
+    fwrite(str.c_str(),1,length,outfile) == (size_t) length;
+}
+
+/*
+ * Reads a string written by `writeString`.
+ *
+ * @return If the string was read.
+ */
+static bool readString(FILE* infile, string& str) {
+  int length;
+  if (fread(&length,sizeof(int),1,infile) != 1 || length < 0) {
+    return false;
+  }
+  str.resize(length);
+  return length == 0 || fread(&str[0],1,length,infile) == (size_t) length;
+}
+
+/*
+ * Reads the header of a checkpoint and checks that it is one, of the layout
+ * this program writes. A checkpoint of another version is reported, since
+ * its layout can not be read.
+ *
+ * @param infile The open checkpoint.
+ * @param header Filled with the header.
+ * @param checkpoint Name of the checkpoint, for the report.
+ *
+ * @return If a valid header was read.
+ */
+static bool readHeader(FILE* infile, CheckpointHeader& header,
+    const string& checkpoint) {
+  if (fread(header.magic,1,8,infile) != 8) {
+    return false;
+  }
+  if (memcmp(header.magic,CHECKPOINT_MAGIC,6) == 0 &&
+      memcmp(header.magic,CHECKPOINT_MAGIC,8) != 0) {
+    cout << "Checkpoint " << checkpoint << " is of version "
+      << string(header.magic + 6,2) << ", this program only reads version "
+      << string(CHECKPOINT_MAGIC + 6,2) << ". Start the run again from its "
+      << "systemfile." << endl;
+    return false;
+  }
+
+  return memcmp(header.magic,CHECKPOINT_MAGIC,8) == 0 &&
+    fread(header.magic + 8,sizeof(header) - 8,1,infile) == 1;
+}
+
+/*
+ * @param checkpoint The checkpoint file.
+ * @return Number of coordinates of each object, 0 if not a checkpoint.
+ */
+int readCheckpointDimensionality(string checkpoint) {
+  FILE* infile = fopen(checkpoint.c_str(),"rb");
+  if (infile == NULL) {
+    return 0;
+  }
+
+  CheckpointHeader header;
+  int dimension = readHeader(infile,header,checkpoint) ? header.dimension : 0;
+  fclose(infile);
+
+  return dimension;
+}
+
+/*
+ * Writes the full state of the system to a checkpoint, from which the run
+ * can be continued bit for bit by `readCheckpoint`. The trajectories are
+ * flushed first, so the files hold every frame up to this point.
+ *
+ * The checkpoint is written to a temporary file which is renamed when
+ * complete, so a run killed while writing leaves the last checkpoint intact.
+ *
+ * @param checkpoint The file to write.
+ */
+template <int D>
+void SolarSystem<D> :: writeCheckpoint(string checkpoint) {
+  if (trajectory != NULL) {
+    trajectory->flush();
+    trajectoryBytes = trajectory->getNoOfBytes();
+    trajectoryFrames = trajectory->getNoOfFrames();
+    trajectoryCounter = trajectory->getCounter();
+  }
+  if (particleTrajectory != NULL) {
+    particleTrajectory->flush();
+    particleBytes = particleTrajectory->getNoOfBytes();
+    particleFrames = particleTrajectory->getNoOfFrames();
+    particleCounter = particleTrajectory->getCounter();
+  }
+
+  CheckpointHeader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,CHECKPOINT_MAGIC,8);
+  header.dimension = D;
+  header.numObjects = N;
+  header.numMassive = numMassive;
+  header.method = method;
+  header.accelerationsValid = accelerationsValid;
+  header.adaptiveStateValid = adaptiveStateValid;
+  header.unitsLength = units.size();
+  header.t = t;
+  header.tolerance = tolerance;
+  header.dpT = dpT;
+  header.dpH = dpH;
+  header.dpTOld = dpTOld;
+  header.dpHOld = dpHOld;
+  header.forceEvaluations = forceEvaluations;
+  header.acceptedSteps = acceptedSteps;
+  header.rejectedSteps = rejectedSteps;
+  header.trajectorySaveEach = trajectorySaveEach;
+  header.trajectoryDt = trajectoryDt;
+  header.trajectoryBytes = trajectoryBytes;
+  header.trajectoryFrames = trajectoryFrames;
+  header.trajectoryCounter = trajectoryCounter;
+  header.particleSaveEach = trajectoryParticleSaveEach;
+  header.particleBytes = particleBytes;
+  header.particleFrames = particleFrames;
+  header.particleCounter = particleCounter;
+  header.elementsBytes = elementsBytes;
+  header.elementsSteps = elementsSteps;
+  header.elementsEach = elementsEach;
+  header.elementsPrimary = elementsPrimary;
+
+  // Temporary name is unique for this process
+  ostringstream oss;
+  oss << checkpoint << ".tmp." << getpid();
+  string tmpPath = oss.str();
+
+  FILE* outfile = fopen(tmpPath.c_str(),"wb");
+  if (outfile == NULL) {
+    cout << "Could not write checkpoint: " << tmpPath << endl;
+    return;
+  }
+
+  int size = 2*D*N;
+  bool ok = fwrite(&header,sizeof(header),1,outfile) == 1;
+  ok = ok && fwrite(units.c_str(),1,units.size(),outfile) == units.size();
+  ok = ok && writeString(outfile,trajectoryFile);
+  ok = ok && writeString(outfile,particleFile);
+  for (int i = 0; i < N; i++) {
+    ok = ok && writeString(outfile,ids[i]);
+  }
+  ok = ok && writeValues(outfile,&m[0],N);
+  for (int d = 0; d < D; d++) {
+    ok = ok && writeValues(outfile,&pos[d][0],N);
+    ok = ok && writeValues(outfile,&vel[d][0],N);
+    ok = ok && writeValues(outfile,&acc[d][0],N);
+  }
+  if (adaptiveStateValid) {
+    ok = ok && writeValues(outfile,&dpY[0],size);
+    for (int k = 0; k < 7; k++) {
+      ok = ok && writeValues(outfile,&dpK[k][0],size);
+    }
+    for (int k = 0; k < 5; k++) {
+      ok = ok && writeValues(outfile,&dpCont[k][0],size);
+    }
+  }
+  ok = ok && fflush(outfile) == 0 && fsync(fileno(outfile)) == 0;
+  ok = (fclose(outfile) == 0) && ok;
+
+  if (!ok || rename(tmpPath.c_str(),checkpoint.c_str()) != 0) {
+    cout << "Could not write checkpoint: " << checkpoint << endl;
+    remove(tmpPath.c_str());
+  }
+}
+
+/*
+ * Replaces the system by the one stored in a checkpoint. The trajectories
+ * are continued where the checkpoint was made, if opened with the same dt and
+ * saveEach. Otherwise new ones are written, see `openTrajectory`.
+ *
+ * @param checkpoint The file to read.
+ */
+template <int D>
+void SolarSystem<D> :: readCheckpoint(string checkpoint) {
+  FILE* infile = fopen(checkpoint.c_str(),"rb");
+  if (infile == NULL) {
+    cout << "Could not open checkpoint: " << checkpoint << endl;
+    exit(1);
+  }
+
+  CheckpointHeader header;
+  if (!readHeader(infile,header,checkpoint) || header.dimension != D) {
+    cout << "Not a checkpoint in " << D << " dimensions: " << checkpoint
+      << endl;
+    exit(1);
+  }
+
+  // Objects are added to size all arrays, then the state is overwritten
+  close();
+  for (int d = 0; d < D; d++) {
+    pos[d].clear(); vel[d].clear(); acc[d].clear();
+    pos0[d].clear(); vel0[d].clear();
+  }
+  m.clear();
+  ids.clear();
+  init();
+
+  units.resize(header.unitsLength);
+  bool ok = header.unitsLength == 0 ||
+    fread(&units[0],1,header.unitsLength,infile) == (size_t) header.unitsLength;
+  ok = ok && readString(infile,trajectoryFile);
+  ok = ok && readString(infile,particleFile);
+
+  string id;
+  vec::fixed<D> zero;
+  zero.zeros();
+  for (int i = 0; ok && i < header.numObjects; i++) {
+    ok = readString(infile,id);
+    if (!ok) {
+      break;
+    }
+    if (i < header.numMassive) {
+      addObject(id,zero,zero,0);
+    } else {
+      addTestParticle(id,zero,zero);
+    }
+  }
+
+  int size = 2*D*N;
+  ok = ok && readValues(infile,&m[0],N);
+  for (int d = 0; ok && d < D; d++) {
+    ok = ok && readValues(infile,&pos[d][0],N);
+    ok = ok && readValues(infile,&vel[d][0],N);
+    ok = ok && readValues(infile,&acc[d][0],N);
+  }
+  if (header.adaptiveStateValid) {
+    resizeAdaptiveState();
+    ok = ok && readValues(infile,&dpY[0],size);
+    for (int k = 0; k < 7; k++) {
+      ok = ok && readValues(infile,&dpK[k][0],size);
+    }
+    for (int k = 0; k < 5; k++) {
+      ok = ok && readValues(infile,&dpCont[k][0],size);
+    }
+  }
+  fclose(infile);
+
+  if (!ok) {
+    cout << "Checkpoint is incomplete: " << checkpoint << endl;
+    exit(1);
+  }
+
+  method = (IntegrationMethod) header.method;
+  accelerationsValid = header.accelerationsValid;
+  adaptiveStateValid = header.adaptiveStateValid;
+  t = header.t;
+  tolerance = header.tolerance;
+  dpT = header.dpT;
+  dpH = header.dpH;
+  dpTOld = header.dpTOld;
+  dpHOld = header.dpHOld;
+  forceEvaluations = header.forceEvaluations;
+  acceptedSteps = header.acceptedSteps;
+  rejectedSteps = header.rejectedSteps;
+
+  trajectorySaveEach = header.trajectorySaveEach;
+  trajectoryDt = header.trajectoryDt;
+  trajectoryBytes = header.trajectoryBytes;
+  trajectoryFrames = header.trajectoryFrames;
+  trajectoryCounter = header.trajectoryCounter;
+  particleSaveEach = header.particleSaveEach;
+  trajectoryParticleSaveEach = header.particleSaveEach;
+  particleBytes = header.particleBytes;
+  particleFrames = header.particleFrames;
+  particleCounter = header.particleCounter;
+  elementsBytes = header.elementsBytes;
+  elementsSteps = header.elementsSteps;
+  elementsEach = header.elementsEach;
+  elementsPrimary = header.elementsPrimary;
+  resumeTrajectory = trajectoryBytes > 0;
+  restoredFrom = checkpoint;
+}
+
+template void SolarSystem<2>::writeCheckpoint(string);
+template void SolarSystem<2>::readCheckpoint(string);
+template void SolarSystem<3>::writeCheckpoint(string);
+template void SolarSystem<3>::readCheckpoint(string);
@@ -0,0 +1,258 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "SolarSystem.hpp"
+
+using namespace std;
+
+/*
+ * Coefficients of the Dormand-Prince 5(4) pair, and of its dense output.
+ * From E. Hairer, S. P. Norsett and G. Wanner, Solving Ordinary Differential
+ * Equations I, and the code DOPRI5.
+ */
+const double DP_C[7] = {0, 1./5, 3./10, 4./5, 8./9, 1, 1};
+const double DP_A[7][6] = {
+  {0},
+  {1./5},
+  {3./40, 9./40},
+  {44./45, -56./15, 32./9},
+  {19372./6561, -25360./2187, 64448./6561, -212./729},
+  {9017./3168, -355./33, 46732./5247, 49./176, -5103./18656},
+  {35./384, 0, 500./1113, 125./192, -2187./6784, 11./84}
+};
+const double DP_E[7] = {71./57600, 0, -71./16695, 71./1920, -17253./339200,
+  22./525, -1./40};
+const double DP_D[7] = {-12715105075./11282082432, 0, 87487479700./32700410799,
+  -10690763975./1880347072, 701980252875./199316789632,
+  -1453857185./822651844, 69997945./29380423};
+
+/*
+ * Limits on how much the step may change from one step to the next.
+ */
+const double DP_SAFETY = 0.9;
+const double DP_MIN_FACTOR = 0.2;
+const double DP_MAX_FACTOR = 5.0;
+
+/*
+ * Smallest step, relative to the time. Steps this small no longer move the
+ * time, so the run is stopped instead.
+ */
+const double DP_MIN_STEP = 1e-12;
+
+/*
+ * Advances the system to t + dt by the adaptive Dormand-Prince 5(4) scheme.
+ *
+ * The integrator keeps its own state and step size between calls, and takes
+ * whatever steps the error control allows. The state arrays are then set by
+ * dense output (a continuous extension of fourth order) at the requested time.
+ * The steps are therefore not tied to the output cadence, dt only decides how
+ * often output is wanted. Large steps are taken in quiet phases, and small
+ * ones only near close approaches. If a close approach needs steps below
+ * DP_MIN_STEP times the time, the program is stopped.
+ *
+ * @param dt Time to advance.
+ */
+template <int D>
+void SolarSystem<D> :: advanceDormandPrince(double dt) {
+  int size = 2*D*N;
+  double target = t + dt;
+
+  if (!adaptiveStateValid) {
+    // Start integrator from the current state
+    resizeAdaptiveState();
+    packState(&dpY[0]);
+    derivatives(&dpY[0],&dpK[0][0]);
+    dpT = t;
+
+    // Dense output of no step gives the state back, for a dt of zero
+    for (int j = 0; j < size; j++) {
+      dpCont[0][j] = dpY[j];
+      for (int k = 1; k < 5; k++) {
+        dpCont[k][j] = 0;
+      }
+    }
+    dpTOld = t;
+    dpHOld = 1;
+    adaptiveStateValid = true;
+  }
+  if (dpH <= 0) {
+    dpH = dt;
+  }
+
+  while (dpT < target) {
+    double h = dpH;
+    double hMin = DP_MIN_STEP * max(fabs(dpT),fabs(target));
+    if (h < hMin) {
+      cout << "Adaptive step " << h << " below smallest step at t = " << dpT
+        << ", objects may be colliding." << endl;
+      exit(1);
+    }
+
+    // Stages 2 to 7. Stage 1 is the last stage of the previous step.
+    for (int s = 1; s < 7; s++) {
+      for (int j = 0; j < size; j++) {
+        double sum = 0;
+        for (int k = 0; k < s; k++) {
+          sum += DP_A[s][k] * dpK[k][j];
+        }
+        dpYNew[j] = dpY[j] + h*sum;
+      }
+      derivatives(&dpYNew[0],&dpK[s][0]);
+    }
+
+    // Error estimate, scaled by the tolerance
+    double err = 0;
+    for (int j = 0; j < size; j++) {
+      double e = 0;
+      for (int k = 0; k < 7; k++) {
+        e += DP_E[k] * dpK[k][j];
+      }
+      double scale = tolerance * (1 + max(fabs(dpY[j]),fabs(dpYNew[j])));
+      err += (h*e / scale) * (h*e / scale);
+    }
+    err = sqrt(err / size);
+
+    // New step size from error
+    double factor = err > 0 ? DP_SAFETY * pow(err,-0.2) : DP_MAX_FACTOR;
+    factor = min(DP_MAX_FACTOR,max(DP_MIN_FACTOR,factor));
+    dpH = h * factor;
+
+    if (!(err <= 1)) {
+      // Rejected, redo with smaller step. Also if the error is not a number
+      rejectedSteps++;
+      continue;
+    }
+    acceptedSteps++;
+
+    // Dense output coefficients for this step
+    for (int j = 0; j < size; j++) {
+      double dy = dpYNew[j] - dpY[j];
+      double bspl = h*dpK[0][j] - dy;
+      double d = 0;
+      for (int k = 0; k < 7; k++) {
+        d += DP_D[k] * dpK[k][j];
+      }
+      dpCont[0][j] = dpY[j];
+      dpCont[1][j] = dy;
+      dpCont[2][j] = bspl;
+      dpCont[3][j] = dy - h*dpK[6][j] - bspl;
+      dpCont[4][j] = h*d;
+    }
+    dpTOld = dpT;
+    dpHOld = h;
+
+    // Accept step, last stage is first stage of next step
+    dpT += h;
+    for (int j = 0; j < size; j++) {
+      dpY[j] = dpYNew[j];
+      dpK[0][j] = dpK[6][j];
+    }
+  }
+
+  // Interpolate state at target time
+  double theta = (target - dpTOld) / dpHOld;
+  double theta1 = 1 - theta;
+  for (int j = 0; j < size; j++) {
+    dpYNew[j] = dpCont[0][j] + theta*(dpCont[1][j] + theta1*(dpCont[2][j] +
+          theta*(dpCont[3][j] + theta1*dpCont[4][j])));
+  }
+  unpackState(&dpYNew[0]);
+
+  accelerationsValid = false;
+}
+
+/*
+ * Sizes the arrays of the adaptive integrator to the number of objects. They
+ * hold fourteen copies of the state, so they are only allocated when the
+ * adaptive integrator is used.
+ */
+template <int D>
+void SolarSystem<D> :: resizeAdaptiveState() {
+  size_t size = 2*D*N;
+  if (dpY.size() == size) {
+    return;
+  }
+
+  dpY.resize(size);
+  dpYNew.resize(size);
+  for (int k = 0; k < 7; k++) {
+    dpK[k].resize(size);
+  }
+  for (int k = 0; k < 5; k++) {
+    dpCont[k].resize(size);
+  }
+}
+
+/*
+ * Right hand side of the equations of motion. The derivative of a position is
+ * the velocity, and that of a velocity is the acceleration.
+ *
+ * @param y State, all positions followed by all velocities.
+ * @param dydt Array to store the derivative of the state in.
+ */
+template <int D>
+void SolarSystem<D> :: derivatives(const double* y, double* dydt) {
+  int half = D*N;
+
+  // Forces need the positions in the state arrays
+  for (int d = 0; d < D; d++) {
+    for (int i = 0; i < N; i++) {
+      pos[d][i] = y[d*N + i];
+    }
+  }
+  updateAccelerations();
+
+  for (int j = 0; j < half; j++) {
+    dydt[j] = y[half + j];
+  }
+  for (int d = 0; d < D; d++) {
+    for (int i = 0; i < N; i++) {
+      dydt[half + d*N + i] = acc[d][i];
+    }
+  }
+}
+
+/*
+ * Copies the state arrays into one array, all positions followed by all
+ * velocities.
+ *
+ * @param y Array of length 2*D*N.
+ */
+template <int D>
+void SolarSystem<D> :: packState(double* y) {
+  int half = D*N;
+  for (int d = 0; d < D; d++) {
+    for (int i = 0; i < N; i++) {
+      y[d*N + i] = pos[d][i];
+      y[half + d*N + i] = vel[d][i];
+    }
+  }
+}
+
+/*
+ * Copies one array, as made by `packState`, back into the state arrays.
+ *
+ * @param y Array of length 2*D*N.
+ */
+template <int D>
+void SolarSystem<D> :: unpackState(const double* y) {
+  int half = D*N;
+  for (int d = 0; d < D; d++) {
+    for (int i = 0; i < N; i++) {
+      pos[d][i] = y[d*N + i];
+      vel[d][i] = y[half + d*N + i];
+    }
+  }
+}
+
+template void SolarSystem<2>::advanceDormandPrince(double);
+template void SolarSystem<2>::resizeAdaptiveState();
+template void SolarSystem<2>::derivatives(const double*,double*);
+template void SolarSystem<2>::packState(double*);
+template void SolarSystem<2>::unpackState(const double*);
+template void SolarSystem<3>::advanceDormandPrince(double);
+template void SolarSystem<3>::resizeAdaptiveState();
+template void SolarSystem<3>::derivatives(const double*,double*);
+template void SolarSystem<3>::packState(double*);
+template void SolarSystem<3>::unpackState(const double*);
@@ -0,0 +1,174 @@
+#include <cmath>
+
+#include "SolarSystem.hpp"
+#include "ButcherTableau.hpp"
+
+using namespace std;
+
+/*
+ * The tableaus are indexed when summing stages, so they need a definition.
+ */
+constexpr double RK4Tableau::a[RK4Tableau::stages+1][RK4Tableau::stages];
+constexpr double RK38Tableau::a[RK38Tableau::stages+1][RK38Tableau::stages];
+constexpr double SSPRK3Tableau::a[SSPRK3Tableau::stages+1]
+  [SSPRK3Tableau::stages];
+constexpr double DormandPrince5Tableau::a[DormandPrince5Tableau::stages+1]
+  [DormandPrince5Tableau::stages];
+
+/*
+ * Advances the system one step by the explicit Runge-Kutta scheme set as
+ * method.
+ *
+ * @param dt The timestep to advance.
+ */
+template <int D>
+void SolarSystem<D> :: advanceRungeKutta(double dt) {
+  switch (method) {
+    case RK38:
+      advanceExplicitRK<RK38Tableau>(dt);
+      break;
+    case SSPRK3:
+      advanceExplicitRK<SSPRK3Tableau>(dt);
+      break;
+    case RK5:
+      advanceExplicitRK<DormandPrince5Tableau>(dt);
+      break;
+    default:
+      advanceExplicitRK<RK4Tableau>(dt);
+      break;
+  }
+}
+
+/*
+ * Advances the system one step by the explicit Runge-Kutta scheme given by a
+ * Butcher tableau. For each stage the K of the position is the velocity at
+ * the stage, and the K of the velocity is the acceleration there.
+ *
+ * The stages are written out at compile time by `explicitRKStage`, and the
+ * sums over earlier stages by `StageSum`, so stages of zero weight cost
+ * nothing. Works in place on the state arrays and stage arrays sized once, so
+ * no memory is allocated while stepping.
+ *
+ * @param dt The timestep to advance.
+ */
+template <int D>
+template <class Tableau>
+void SolarSystem<D> :: advanceExplicitRK(double dt) {
+  static_assert(Tableau::stages <= RK_MAX_STAGES,
+    "Tableau has more stages than RK_MAX_STAGES, raise it in SolarSystem.hpp");
+  resizeStages(Tableau::stages);
+
+  // Start of step, the velocity is also the K of the position at stage 0
+  for (int d = 0; d < D; d++) {
+    const double* p = &pos[d][0];
+    const double* v = &vel[d][0];
+    double* p0 = &pos0[d][0];
+    double* v0 = &stageV[0][d][0];
+
+    #pragma omp parallel for if (N >= PARALLEL_MIN_OBJECTS)
+    for (int i = 0; i < N; i++) {
+      p0[i] = p[i];
+      v0[i] = v[i];
+    }
+  }
+
+  explicitRKStage<Tableau,0>(dt);
+
+  // Last accelerations were found at a stage, not at the new positions. Acc
+  // holds scratch from the swaps, so it must be found again before use
+  accelerationsValid = false;
+}
+
+/*
+ * Stage s of an explicit Runge-Kutta step. Moves the positions to where the
+ * stage is evaluated, finds the velocity there from the accelerations of the
+ * earlier stages, and then the accelerations. Continues with the next stage.
+ *
+ * @param dt The timestep to advance.
+ */
+template <int D>
+template <class Tableau, int s>
+typename std::enable_if<(s < Tableau::stages)>::type
+SolarSystem<D> :: explicitRKStage(double dt) {
+  if (s > 0) {
+    for (int d = 0; d < D; d++) {
+      const double* KV[RK_MAX_STAGES];
+      const double* KA[RK_MAX_STAGES];
+      for (int k = 0; k < s; k++) {
+        KV[k] = &stageV[k][d][0];
+        KA[k] = &stageA[k][d][0];
+      }
+      double* p = &pos[d][0];
+      double* v = &stageV[s][d][0];
+      const double* p0 = &pos0[d][0];
+      const double* v0 = &stageV[0][d][0];
+
+      #pragma omp parallel for if (N >= PARALLEL_MIN_OBJECTS)
+      for (int i = 0; i < N; i++) {
+        p[i] = p0[i] + dt * StageSum<Tableau,s,s>::of(KV,i);
+        v[i] = v0[i] + dt * StageSum<Tableau,s,s>::of(KA,i);
+      }
+    }
+  }
+
+  // The stage keeps the accelerations, the old stage arrays become scratch
+  updateAccelerations();
+  for (int d = 0; d < D; d++) {
+    acc[d].swap(stageA[s][d]);
+  }
+
+  explicitRKStage<Tableau,s+1>(dt);
+}
+
+/*
+ * End of an explicit Runge-Kutta step. Takes the step from the start with
+ * the weighted sum of the stages.
+ *
+ * @param dt The timestep to advance.
+ */
+template <int D>
+template <class Tableau, int s>
+typename std::enable_if<(s == Tableau::stages)>::type
+SolarSystem<D> :: explicitRKStage(double dt) {
+  for (int d = 0; d < D; d++) {
+    const double* KV[RK_MAX_STAGES];
+    const double* KA[RK_MAX_STAGES];
+    for (int k = 0; k < s; k++) {
+      KV[k] = &stageV[k][d][0];
+      KA[k] = &stageA[k][d][0];
+    }
+    double* p = &pos[d][0];
+    double* v = &vel[d][0];
+    const double* p0 = &pos0[d][0];
+    const double* v0 = &stageV[0][d][0];
+
+    #pragma omp parallel for if (N >= PARALLEL_MIN_OBJECTS)
+    for (int i = 0; i < N; i++) {
+      p[i] = p0[i] + dt * StageSum<Tableau,s,s>::of(KV,i);
+      v[i] = v0[i] + dt * StageSum<Tableau,s,s>::of(KA,i);
+    }
+  }
+}
+
+/*
+ * Sizes the stage arrays to the number of objects, for a scheme with the
+ * given number of stages.
+ *
+ * @param stages Stages of the scheme.
+ */
+template <int D>
+void SolarSystem<D> :: resizeStages(int stages) {
+  for (int s = 0; s < stages; s++) {
+    for (int d = 0; d < D; d++) {
+      if (stageV[s][d].size() != (size_t) N) {
+        stageV[s][d].resize(N);
+        stageA[s][d].resize(N);
+      }
+    }
+  }
+}
+
+template void SolarSystem<2>::advanceRungeKutta(double);
+template void SolarSystem<2>::resizeStages(int);
+template void SolarSystem<3>::advanceRungeKutta(double);
+template void SolarSystem<3>::resizeStages(int);
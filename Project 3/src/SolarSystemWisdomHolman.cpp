@@ -0,0 +1,335 @@
+#include <cmath>
+#include <iostream>
+
+#include "SolarSystem.hpp"
+
+using namespace std;
+
+/*
+ * Max number of iterations when solving Kepler's equation.
+ */
+const int KEPLER_MAX_ITERATIONS = 50;
+
+/*
+ * Times a drift is split in two halves when Kepler's equation does not
+ * converge, before giving up.
+ */
+const int KEPLER_MAX_HALVINGS = 8;
+
+/*
+ * Finds the Stumpff functions c0, c1, c2 and c3 of x. A series is used close
+ * to zero, where the closed forms lose precision.
+ *
+ * @param x Argument, beta*s^2 in the universal variable formulation.
+ * @param c Array to store c0..c3 in.
+ */
+static void stumpff(double x, double* c) {
+  if (fabs(x) < 0.1) {
+    // Series: c_k(x) = sum_n (-x)^n / (k + 2n)!
+    double term2 = 0.5, term3 = 1.0/6;
+    c[2] = 0; c[3] = 0;
+    for (int n = 0; n < 10; n++) {
+      c[2] += term2;
+      c[3] += term3;
+      term2 *= -x / ((2*n + 3) * (2*n + 4));
+      term3 *= -x / ((2*n + 4) * (2*n + 5));
+    }
+    c[1] = 1 - x*c[3];
+    c[0] = 1 - x*c[2];
+  } else if (x > 0) {
+    double z = sqrt(x);
+    c[0] = cos(z);
+    c[1] = sin(z) / z;
+    c[2] = (1 - c[0]) / x;
+    c[3] = (1 - c[1]) / x;
+  } else {
+    double z = sqrt(-x);
+    c[0] = cosh(z);
+    c[1] = sinh(z) / z;
+    c[2] = (1 - c[0]) / x;
+    c[3] = (1 - c[1]) / x;
+  }
+}
+
+/*
+ * Moves one object along its Kepler orbit around a fixed centre by the
+ * universal variable method, which works for all types of orbits. Kepler's
+ * equation is solved for the universal anomaly s by Halley's method, then the
+ * orbit is propagated by the f and g functions.
+ *
+ * @param r Position relative to centre, updated in place.
+ * @param v Velocity, updated in place.
+ * @param mu Gravitational parameter of the centre.
+ * @param dt Time to move.
+ *
+ * @return False if the iterations ran out before s converged. The object is
+ * then moved by the last iterate.
+ */
+template <int D>
+static bool keplerDrift(double* r, double* v, double mu, double dt) {
+  double r0 = 0, v2 = 0, eta0 = 0;
+  for (int d = 0; d < D; d++) {
+    r0 += r[d]*r[d];
+    v2 += v[d]*v[d];
+    eta0 += r[d]*v[d];
+  }
+  r0 = sqrt(r0);
+  double beta = 2*mu/r0 - v2;   // Positive for bound orbits
+  double zeta0 = mu - beta*r0;
+
+  // Solve r0*s*c1 + eta0*s^2*c2 + mu*s^3*c3 = dt
+  double c[4];
+  double s = dt / r0;
+  double rNew = r0;
+  bool converged = false;
+  for (int it = 0; it < KEPLER_MAX_ITERATIONS; it++) {
+    double s2 = s*s;
+    stumpff(beta*s2,c);
+
+    double f = r0*s*c[1] + eta0*s2*c[2] + mu*s2*s*c[3] - dt;
+    rNew = r0*c[0] + eta0*s*c[1] + mu*s2*c[2];    // df/ds
+    double df2 = eta0*c[0] + zeta0*s*c[1];        // d^2f/ds^2
+
+    double ds = -f / rNew;
+    ds = -f / (rNew + 0.5*ds*df2);
+    s += ds;
+
+    if (fabs(ds) <= 1e-15 * fabs(s)) {
+      converged = true;
+      break;
+    }
+  }
+
+  // Make sure c and rNew belong to the final s
+  double s2 = s*s;
+  stumpff(beta*s2,c);
+  rNew = r0*c[0] + eta0*s*c[1] + mu*s2*c[2];
+
+  double f = 1 - mu*s2*c[2] / r0;
+  double g = dt - mu*s2*s*c[3];
+  double fdot = -mu*s*c[1] / (rNew*r0);
+  double gdot = 1 - mu*s2*c[2] / rNew;
+
+  for (int d = 0; d < D; d++) {
+    double rOld = r[d];
+    double vOld = v[d];
+    r[d] = f*rOld + g*vOld;
+    v[d] = fdot*rOld + gdot*vOld;
+  }
+
+  return converged;
+}
+
+/*
+ * Moves one object along its Kepler orbit like `keplerDrift`. If Kepler's
+ * equation does not converge, the drift is instead done as two drifts of half
+ * the time, each of which may be split again. Shorter drifts start closer to
+ * the solution, so they converge more easily.
+ *
+ * @param r Position relative to centre, updated in place.
+ * @param v Velocity, updated in place.
+ * @param mu Gravitational parameter of the centre.
+ * @param dt Time to move.
+ * @param halvings How many more times the drift may be split.
+ *
+ * @return False if some drift did not converge even when split.
+ */
+template <int D>
+static bool splitKeplerDrift(double* r, double* v, double mu, double dt,
+    int halvings) {
+  double rOld[D],vOld[D];
+  for (int d = 0; d < D; d++) {
+    rOld[d] = r[d];
+    vOld[d] = v[d];
+  }
+
+  bool converged = keplerDrift<D>(r,v,mu,dt);
+  if (converged || halvings == 0) {
+    return converged;
+  }
+
+  for (int d = 0; d < D; d++) {
+    r[d] = rOld[d];
+    v[d] = vOld[d];
+  }
+  bool first = splitKeplerDrift<D>(r,v,mu,0.5*dt,halvings-1);
+  bool second = splitKeplerDrift<D>(r,v,mu,0.5*dt,halvings-1);
+  return first && second;
+}
+
+/*
+ * Advances the system one step by the Wisdom-Holman mixed variable map in
+ * democratic heliocentric coordinates (Duncan, Levison & Lee 1998). The first
+ * object is taken to be the dominating central body.
+ *
+ * The Hamiltonian is split in Kepler motion of every object around the
+ * central body, which is done exactly, the interaction between the other
+ * objects, done as kicks, and a drift from the momentum of the central body.
+ * A step is kick, drift, Kepler, drift, kick. The kicks only need the forces
+ * between the smaller objects, which are weak, so steps can be a few percent
+ * of the shortest orbital period.
+ *
+ * The state arrays stay inertial. They are converted to heliocentric
+ * positions and barycentric velocities (in the scratch arrays) at the start
+ * of the step and back at the end.
+ *
+ * @param dt The timestep to advance.
+ */
+template <int D>
+void SolarSystem<D> :: advanceWisdomHolman(double dt) {
+  double M = 0;
+  double R[D],Vcm[D];
+  double m0 = m[0];
+
+  // Barycentre
+  for (int d = 0; d < D; d++) {
+    R[d] = 0;
+    Vcm[d] = 0;
+  }
+  for (int i = 0; i < N; i++) {
+    M += m[i];
+    for (int d = 0; d < D; d++) {
+      R[d] += m[i]*pos[d][i];
+      Vcm[d] += m[i]*vel[d][i];
+    }
+  }
+  for (int d = 0; d < D; d++) {
+    R[d] /= M;
+    Vcm[d] /= M;
+  }
+
+  // To heliocentric positions Q and barycentric velocities V
+  vector<double>* Q = pos0;
+  vector<double>* V = vel0;
+  for (int d = 0; d < D; d++) {
+    for (int i = 1; i < N; i++) {
+      Q[d][i] = pos[d][i] - pos[d][0];
+      V[d][i] = vel[d][i] - Vcm[d];
+    }
+  }
+
+  interactionKick(0.5*dt);
+  sunDrift(0.5*dt);
+
+  int failed = 0;
+  #pragma omp parallel for schedule(dynamic,PARTICLE_BLOCK) reduction(+:failed) if (N >= PARALLEL_MIN_OBJECTS)
+  for (int i = 1; i < N; i++) {
+    double r[D],v[D];
+    for (int d = 0; d < D; d++) {
+      r[d] = Q[d][i];
+      v[d] = V[d][i];
+    }
+    if (!splitKeplerDrift<D>(r,v,m0,dt,KEPLER_MAX_HALVINGS)) {
+      failed++;
+    }
+    for (int d = 0; d < D; d++) {
+      Q[d][i] = r[d];
+      V[d][i] = v[d];
+    }
+  }
+
+  if (failed > 0) {
+    cout << "Warning: Kepler's equation did not converge for " << failed
+      << " objects in the step from t = " << t << "." << endl;
+  }
+
+  sunDrift(0.5*dt);
+  interactionKick(0.5*dt);
+
+  // Back to inertial coordinates. Barycentre moves freely.
+  for (int d = 0; d < D; d++) {
+    double mQ = 0, mV = 0;
+    for (int i = 1; i < N; i++) {
+      mQ += m[i]*Q[d][i];
+      mV += m[i]*V[d][i];
+    }
+
+    pos[d][0] = R[d] + Vcm[d]*dt - mQ / M;
+    vel[d][0] = Vcm[d] - mV / m0;
+    for (int i = 1; i < N; i++) {
+      pos[d][i] = Q[d][i] + pos[d][0];
+      vel[d][i] = V[d][i] + Vcm[d];
+    }
+  }
+
+  accelerationsValid = false;
+}
+
+/*
+ * Kicks the barycentric velocities with the gravity between all objects but
+ * the central one, using the heliocentric positions. Pairwise like
+ * `updateAccelerations`. Test particles are only kicked by the massive
+ * objects.
+ *
+ * @param h Length of kick.
+ */
+template <int D>
+void SolarSystem<D> :: interactionKick(double h) {
+  vector<double>* Q = pos0;
+  vector<double>* V = vel0;
+  double r[D];
+  forceEvaluations++;
+
+  for (int i = 1; i < numMassive; i++) {
+    for (int j = i+1; j < numMassive; j++) {
+      double dist2 = 0;
+      for (int d = 0; d < D; d++) {
+        r[d] = Q[d][j] - Q[d][i];
+        dist2 += r[d]*r[d];
+      }
+      double invDist3 = h / (dist2*sqrt(dist2));
+
+      for (int d = 0; d < D; d++) {
+        V[d][i] += r[d] * m[j] * invDist3;
+        V[d][j] -= r[d] * m[i] * invDist3;
+      }
+    }
+  }
+
+  #pragma omp parallel for schedule(static) if (N - numMassive >= PARALLEL_MIN_OBJECTS)
+  for (int j = numMassive; j < N; j++) {
+    double r_j[D];
+    for (int i = 1; i < numMassive; i++) {
+      double dist2 = 0;
+      for (int d = 0; d < D; d++) {
+        r_j[d] = Q[d][i] - Q[d][j];
+        dist2 += r_j[d]*r_j[d];
+      }
+      double factor = h * m[i] / (dist2*sqrt(dist2));
+
+      for (int d = 0; d < D; d++) {
+        V[d][j] += r_j[d] * factor;
+      }
+    }
+  }
+}
+
+/*
+ * Drifts the heliocentric positions by the total momentum of the smaller
+ * objects, which the central body must balance.
+ *
+ * @param h Length of drift.
+ */
+template <int D>
+void SolarSystem<D> :: sunDrift(double h) {
+  vector<double>* Q = pos0;
+  vector<double>* V = vel0;
+
+  for (int d = 0; d < D; d++) {
+    double P = 0;
+    for (int i = 1; i < N; i++) {
+      P += m[i]*V[d][i];
+    }
+    double shift = h * P / m[0];
+    for (int i = 1; i < N; i++) {
+      Q[d][i] += shift;
+    }
+  }
+}
+
+template void SolarSystem<2>::advanceWisdomHolman(double);
+template void SolarSystem<2>::interactionKick(double);
+template void SolarSystem<2>::sunDrift(double);
+template void SolarSystem<3>::advanceWisdomHolman(double);
+template void SolarSystem<3>::interactionKick(double);
+template void SolarSystem<3>::sunDrift(double);
@@ -0,0 +1,300 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+#include "TrajectoryWriter.hpp"
+
+using namespace std;
+
+/*
+ * Size of each of the two buffers.
+ */
+const int BUFFER_BYTES = 1 << 22;
+
+/*
+ * Starts the writer thread. The file is opened by `writeHeader` for a new
+ * trajectory, or by `resume` to continue an old one.
+ *
+ * @param filename Path of the file to write.
+ * @param dimension Number of coordinates per object.
+ * @param saveEach Only every saveEach-th frame given is stored.
+ */
+TrajectoryWriter :: TrajectoryWriter(string filename, int dimension, int saveEach) {
+  this->dimension = dimension;
+  this->saveEach = saveEach > 0 ? saveEach : 1;
+  counter = 0;
+  frames = 0;
+  frameSize = 0;
+  framesPerBuffer = 0;
+  active = 0;
+  filled = 0;
+  pendingFrames = 0;
+  pending = false;
+  stopping = false;
+  failed = false;
+  headerBytes = 0;
+  file = NULL;
+  this->filename = filename;
+
+  writer = thread(&TrajectoryWriter::writerLoop,this);
+}
+
+TrajectoryWriter :: ~TrajectoryWriter() {
+  close();
+}
+
+/*
+ * Opens a new file and writes the header. Must be called before any frames
+ * are added, unless the trajectory is resumed.
+ *
+ * @param ids Names of all objects.
+ * @param masses Masses of all objects.
+ * @param units Description of units used.
+ * @param dt Time step of simulation.
+ */
+void TrajectoryWriter :: writeHeader(vector<string>& ids, vector<double>& masses,
+    string units, double dt) {
+  int N = ids.size();
+  int length;
+
+  openFile("wb");
+
+  bool written = fwrite("SSTRAJ01",1,8,file) == 8;
+  written &= fwrite(&dimension,sizeof(int),1,file) == 1;
+  written &= fwrite(&N,sizeof(int),1,file) == 1;
+  written &= fwrite(&saveEach,sizeof(int),1,file) == 1;
+  written &= fwrite(&dt,sizeof(double),1,file) == 1;
+
+  length = units.size();
+  written &= fwrite(&length,sizeof(int),1,file) == 1;
+  written &= fwrite(units.c_str(),1,length,file) == (size_t) length;
+
+  for (int i = 0; i < N; i++) {
+    length = ids[i].size();
+    written &= fwrite(&length,sizeof(int),1,file) == 1;
+    written &= fwrite(ids[i].c_str(),1,length,file) == (size_t) length;
+    written &= fwrite(&masses[i],sizeof(double),1,file) == 1;
+  }
+  checkWrite(written);
+  headerBytes = ftell(file);
+
+  allocateBuffers(N);
+}
+
+/*
+ * Continues a trajectory written earlier, from the point given by
+ * `getNoOfBytes`, `getNoOfFrames` and `getCounter` at that time. Anything
+ * written to the file after that point is cut away.
+ *
+ * @param N Number of objects.
+ * @param bytes Size of file to continue from.
+ * @param frames Number of frames stored up to that point.
+ * @param counter Number of frames given up to that point.
+ */
+void TrajectoryWriter :: resume(int N, long bytes, long frames, long counter) {
+  openFile("r+b");
+
+  frameSize = 1 + dimension*N;
+  headerBytes = bytes - frames*frameSize*sizeof(double);
+  this->frames = frames;
+  this->counter = counter;
+
+  if (ftruncate(fileno(file),bytes) != 0 || fseek(file,bytes,SEEK_SET) != 0) {
+    cout << "Could not resume trajectory file: " << filename << endl;
+    exit(1);
+  }
+
+  allocateBuffers(N);
+}
+
+/*
+ * Opens the file.
+ *
+ * @param mode Mode given to fopen.
+ */
+void TrajectoryWriter :: openFile(const char* mode) {
+  file = fopen(filename.c_str(),mode);
+  if (file == NULL) {
+    cout << "Could not open trajectory file: " << filename << endl;
+    exit(1);
+  }
+}
+
+/*
+ * Sizes the buffers from the frame size.
+ *
+ * @param N Number of objects.
+ */
+void TrajectoryWriter :: allocateBuffers(int N) {
+  frameSize = 1 + dimension*N;
+  framesPerBuffer = BUFFER_BYTES / (frameSize*sizeof(double));
+  if (framesPerBuffer < 1) {
+    framesPerBuffer = 1;
+  }
+  buffers[0].resize(framesPerBuffer*frameSize);
+  buffers[1].resize(framesPerBuffer*frameSize);
+}
+
+/*
+ * Gives a new frame. Only every saveEach-th frame is stored, the first one
+ * always is. Copies the positions, so the arrays can be changed right after.
+ *
+ * @param t Time of frame.
+ * @param pos Array of dimension vectors, holding each coordinate of all
+ * objects.
+ * @param first Index of first object to store.
+ * @param N Number of objects to store.
+ */
+void TrajectoryWriter :: addFrame(double t, const vector<double>* pos, int first,
+    int N) {
+  if (counter++ % saveEach != 0) {
+    return;
+  }
+
+  double* frame = &buffers[active][filled*frameSize];
+  frame[0] = t;
+  for (int d = 0; d < dimension; d++) {
+    memcpy(frame + 1 + d*N,&pos[d][first],N*sizeof(double));
+  }
+  filled++;
+  frames++;
+
+  if (filled == framesPerBuffer) {
+    handOver();
+  }
+}
+
+/*
+ * Gives the active buffer to the writer thread and starts filling the other
+ * one. Waits only if the writer is not done with the other one yet.
+ */
+void TrajectoryWriter :: handOver() {
+  unique_lock<mutex> lock(lockMutex);
+  while (pending) {
+    changed.wait(lock);
+  }
+  checkWrite(!failed);
+
+  pendingFrames = filled;
+  pending = true;
+  active = 1 - active;
+  filled = 0;
+
+  changed.notify_all();
+}
+
+/*
+ * Run by the writer thread. Writes buffers as they are handed over, until
+ * told to stop.
+ */
+void TrajectoryWriter :: writerLoop() {
+  unique_lock<mutex> lock(lockMutex);
+
+  while (true) {
+    while (!pending && !stopping) {
+      changed.wait(lock);
+    }
+    if (!pending && stopping) {
+      return;
+    }
+
+    // Buffer being written is the one not active
+    int toWrite = 1 - active;
+    int numFrames = pendingFrames;
+
+    lock.unlock();
+    long numValues = (long) numFrames*frameSize;
+    bool written = fwrite(&buffers[toWrite][0],sizeof(double),numValues,file)
+      == (size_t) numValues;
+    lock.lock();
+
+    failed |= !written;
+    pending = false;
+    changed.notify_all();
+  }
+}
+
+/*
+ * Makes sure all frames given so far are on disk. Waits for the writer
+ * thread, so it should only be used now and then, e.g. before a checkpoint.
+ */
+void TrajectoryWriter :: flush() {
+  if (filled > 0) {
+    handOver();
+  }
+
+  bool written;
+  {
+    unique_lock<mutex> lock(lockMutex);
+    while (pending) {
+      changed.wait(lock);
+    }
+    written = !failed;
+  }
+
+  written &= fflush(file) == 0;
+  written &= fsync(fileno(file)) == 0;
+  checkWrite(written);
+}
+
+/*
+ * Writes what is left in the buffers, stops the writer thread and closes the
+ * file.
+ */
+void TrajectoryWriter :: close() {
+  if (stopping) {
+    return;
+  }
+
+  if (file != NULL && filled > 0) {
+    handOver();
+  }
+
+  {
+    lock_guard<mutex> lock(lockMutex);
+    stopping = true;
+    changed.notify_all();
+  }
+  writer.join();
+
+  if (file != NULL) {
+    bool written = !failed;
+    written &= fclose(file) == 0;
+    file = NULL;
+    checkWrite(written);
+  }
+}
+
+/*
+ * Stops the program if a write failed, as the trajectory is then incomplete.
+ *
+ * @param written False if a write failed.
+ */
+void TrajectoryWriter :: checkWrite(bool written) {
+  if (!written) {
+    cout << "Could not write trajectory file: " << filename << endl;
+    exit(1);
+  }
+}
+
+/*
+ * @return Number of frames stored so far.
+ */
+long TrajectoryWriter :: getNoOfFrames() {
+  return frames;
+}
+
+/*
+ * @return Size of file when all frames stored so far are written.
+ */
+long TrajectoryWriter :: getNoOfBytes() {
+  return headerBytes + frames*frameSize*sizeof(double);
+}
+
+/*
+ * @return Number of frames given so far, stored or not.
+ */
+long TrajectoryWriter :: getCounter() {
+  return counter;
+}
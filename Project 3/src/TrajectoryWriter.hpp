@@ -0,0 +1,68 @@
+#ifndef TRAJECTORYWRITER_HPP
+#define TRAJECTORYWRITER_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * Writes the positions of all objects of a system to one binary file. Frames
+ * are collected in a large buffer, and full buffers are written by a
+ * background thread while the next one is filled, so the simulation does not
+ * wait for the disk. A failed write stops the program.
+ *
+ * File layout, all little endian as written by the machine:
+ *   char[8]  "SSTRAJ01"
+ *   int32    dimension, number of objects N, saveEach
+ *   double   dt (time between frames is dt*saveEach)
+ *   int32    length of units string, then the string
+ *   N times: int32 length of id, the id, double mass
+ *   frames:  double t, then positions as x of all objects, y of all ...
+ */
+class TrajectoryWriter {
+  public:
+    TrajectoryWriter(std::string,int,int);
+    ~TrajectoryWriter();
+
+    void writeHeader(std::vector<std::string>&,std::vector<double>&,
+        std::string,double);
+    void resume(int,long,long,long);
+    void addFrame(double,const std::vector<double>*,int,int);
+    void flush();
+    void close();
+
+    long getNoOfFrames(),getNoOfBytes(),getCounter();
+
+  private:
+    int dimension,saveEach;
+    int framesPerBuffer,frameSize;
+    long frames,counter,headerBytes;
+
+    std::string filename;
+    FILE* file;
+
+    /*
+     * Two buffers, one is filled while the other is written.
+     */
+    std::vector<double> buffers[2];
+    int active;                         // Buffer being filled
+    int filled;                         // Frames in active buffer
+    int pendingFrames;                  // Frames in buffer being written
+
+    std::thread writer;
+    std::mutex lockMutex;
+    std::condition_variable changed;
+    bool pending,stopping;
+    bool failed;                        // A write of the writer thread failed
+
+    void openFile(const char*);
+    void allocateBuffers(int);
+    void handOver();
+    void writerLoop();
+    void checkWrite(bool);
+};
+
+#endif // TRAJECTORYWRITER_HPP
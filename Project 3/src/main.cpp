@@ -1,40 +1,413 @@
 #include <iostream>
+#include <cstring>
+#include <chrono>
 #include <armadillo>
 
 #include "SolarSystem.hpp"
+#include "Ensemble.hpp"
+#include "ConservationMonitor.hpp"
+#include "Parareal.hpp"
+#include "OrbitalElementWriter.hpp"
 
 using namespace std;
 using namespace arma;
 
+/*
+ * Constants
+ */
+const long CHECKPOINT_EVERY = 100000;   // Default steps between checkpoints
+const double CHECKPOINT_MAX_FRACTION = 0.01; // Of run time spent on them
+const string ENSEMBLE_OUTPUT = "../data/ensemble.dat";
+const int MONITOR_EVERY = 100;          // Default steps between samples
+const string MONITOR_OUTPUT = "../data/conservation.dat";
+const double PARAREAL_COARSE_FACTOR = 10;     // Coarse step over dt
+const double PARAREAL_TOLERANCE = 1e-8;       // Default defect to stop at
+const string PARAREAL_OUTPUT = "../data/parareal.dat";
+const string ELEMENTS_OUTPUT = "../data/elements.dat";
+const string ELEMENT_STATS_OUTPUT = "../data/elementStats.dat";
+
+/*
+ * How the simulation is to be run, as given on the commandline.
+ */
+struct RunSettings {
+  double dt;                    // Step size
+  double T;                     // Time to simulate to
+  IntegrationMethod method;     // Integration scheme
+  bool methodGiven;             // If method is given, else kept on restart
+  double tolerance;             // Error tolerance of adaptive scheme
+  bool toleranceGiven;          // If tolerance is given, else kept on restart
+  int saveEach;                 // Only every saveEach-th step is saved
+  string checkpoint;            // File to checkpoint to, empty if none
+  long checkpointEvery;         // Steps between checkpoints
+  bool restart;                 // If infile is a checkpoint to continue from
+  string ensemble;              // File listing ensemble members, empty if none
+  string particles;             // File of test particles, empty if none
+  int particleSaveEach;         // Saved steps per saved particle step, 0 keeps
+  int monitorEach;              // Steps between conservation samples, 0 off
+  double maxDrift;              // Relative drift flagged, 0 for none
+  bool abortOnDrift;            // If the run stops when drift is flagged
+  PararealSettings parareal;    // Slices is 0 unless run by Parareal
+  int elementsEach;             // Steps between orbital elements, 0 off
+  string primary;               // Object orbited, empty for the first
+  bool elementStats;            // If min, max and mean of elements are kept
+};
+
+/*
+ * Runs the simulation in D dimensions and stores the trajectory.
+ *
+ * Checkpoints are written every checkpointEvery steps. The time each one
+ * takes is measured, and the interval is made longer if needed to keep
+ * checkpoints below CHECKPOINT_MAX_FRACTION of the time spent stepping, so a
+ * slow disk can not dominate the run.
+ *
+ * Conserved quantities are sampled every monitorEach steps and logged to
+ * MONITOR_OUTPUT. Drift is measured from the start of this run, also when
+ * restarting.
+ *
+ * If orbital elements are written every elementsEach steps, no trajectory is.
+ *
+ * @param infile The systemfile, or checkpoint if restarting.
+ * @param settings How to run.
+ */
+template <int D>
+void simulate(string infile, RunSettings settings) {
+  SolarSystem<D> mySystem;
+  if (settings.restart) {
+    mySystem.readCheckpoint(infile);
+  } else {
+    mySystem = SolarSystem<D>(infile);
+    if (!settings.particles.empty()) {
+      mySystem.addTestParticles(settings.particles);
+    }
+  }
+  if (settings.particleSaveEach > 0) {
+    mySystem.setParticleSaveEach(settings.particleSaveEach);
+  }
+
+  if (!settings.restart || settings.methodGiven) {
+    mySystem.setIntegrationMethod(settings.method);
+  }
+  if (!settings.restart || settings.toleranceGiven) {
+    mySystem.setTolerance(settings.tolerance);
+  }
+
+  if (!settings.ensemble.empty()) {
+    vector<EnsembleMember> members = readEnsemble(settings.ensemble);
+    runEnsemble(mySystem,members,settings.dt,settings.T,ENSEMBLE_OUTPUT);
+    return;
+  }
+
+  if (settings.parareal.slices > 0) {
+    runParareal(mySystem,settings.dt,settings.T,settings.parareal,
+        PARAREAL_OUTPUT);
+    if (!settings.checkpoint.empty()) {
+      mySystem.writeCheckpoint(settings.checkpoint);
+    }
+    return;
+  }
+
+  OrbitalElementWriter<D>* elements = NULL;
+  if (settings.elementsEach > 0) {
+    string primary = settings.primary.empty() ?
+      mySystem.getObject(0).getId() : settings.primary;
+    elements = new OrbitalElementWriter<D>(mySystem,ELEMENTS_OUTPUT,
+        settings.elementsEach,primary,
+        settings.elementStats ? ELEMENT_STATS_OUTPUT : "");
+  } else {
+    // A later restart has no element output of this run to continue
+    mySystem.setElementsOutput(0,0,0,-1);
+    mySystem.openTrajectory(settings.dt,settings.saveEach);
+  }
+
+  ConservationMonitor<D>* monitor = NULL;
+  bool driftFlagged = false;
+  if (settings.monitorEach > 0) {
+    monitor = new ConservationMonitor<D>(mySystem,MONITOR_OUTPUT,
+        settings.monitorEach,settings.maxDrift);
+  }
+
+  double t = mySystem.getT();
+  long checkpointEvery = settings.checkpointEvery;
+  long nextCheckpoint = checkpointEvery;
+  long steps = 0;
+  int checkpoints = 0;
+  double checkpointTime = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  while (t < settings.T) {
+    mySystem.advance(settings.dt);
+    t += settings.dt;
+    steps++;
+
+    if (elements != NULL) {
+      elements->check();
+    }
+
+    if (monitor != NULL && !monitor->check() && !driftFlagged) {
+      driftFlagged = true;
+      cout << "Relative drift passed " << settings.maxDrift << " at t = "
+        << monitor->getExceededAt() << "." << endl;
+      if (settings.abortOnDrift) {
+        cout << "Stopping simulation." << endl;
+        break;
+      }
+    }
+
+    if (!settings.checkpoint.empty() && steps == nextCheckpoint) {
+      chrono::steady_clock::time_point before = chrono::steady_clock::now();
+      if (elements != NULL) {
+        elements->prepareCheckpoint();
+      }
+      mySystem.writeCheckpoint(settings.checkpoint);
+      chrono::steady_clock::time_point after = chrono::steady_clock::now();
+
+      double cost = chrono::duration<double>(after - before).count();
+      double stepTime = (chrono::duration<double>(before - start).count() -
+          checkpointTime) / steps;
+      checkpoints++;
+      checkpointTime += cost;
+
+      // Enough steps between checkpoints to keep within the fraction
+      long minimumEvery = (long) (cost / (CHECKPOINT_MAX_FRACTION*stepTime)) + 1;
+      if (checkpointEvery < minimumEvery) {
+        checkpointEvery = minimumEvery;
+      }
+      nextCheckpoint = steps + checkpointEvery;
+    }
+  }
+
+  mySystem.close();
+  if (elements != NULL) {
+    elements->close();
+    delete elements;
+  }
+  if (monitor != NULL) {
+    monitor->close();
+    cout << "Largest relative drift of energy " << monitor->getMaxEnergyDrift()
+      << ", of angular momentum " << monitor->getMaxAngularMomentumDrift()
+      << ". Barycentre drifted " << monitor->getMaxBarycentreDrift() << "."
+      << endl;
+    delete monitor;
+  }
+
+  cout << "Finished simulation. Used " << mySystem.getNoOfForceEvaluations()
+    << " force evaluations." << endl;
+  if (mySystem.getIntegrationMethod() == DORMAND_PRINCE) {
+    cout << "Adaptive steps: " << mySystem.getNoOfAcceptedSteps() <<
+      " accepted, " << mySystem.getNoOfRejectedSteps() << " rejected." << endl;
+  }
+  if (checkpoints > 0) {
+    double runTime = chrono::duration<double>(chrono::steady_clock::now() -
+        start).count();
+    cout << "Wrote " << checkpoints << " checkpoints in " << checkpointTime
+      << " s (" << 100 * checkpointTime / runTime << " % of run time)."
+      << endl;
+  }
+}
+
 /*
  * Main method takes a systemfile containing the setup of the system being
  * simulated, a dt and a T (how long the simulation is to run). All times are
- * in years.
+ * in years. Optionally the integration scheme can be chosen, default is RK4.
+ * For the adaptive scheme dopri, dt is only how often positions are saved and
+ * the step is chosen from the tolerance.
+ *
+ * Positions are written to one binary file. With -saveEach only every n-th
+ * step is written.
+ *
+ * With -checkpoint the full state is written to the given file every
+ * -checkpointEvery steps. A run is continued from a checkpoint by giving it
+ * in place of the systemfile along with -restart. T is then still the time
+ * to simulate to. Scheme and tolerance are kept unless given, and the
+ * trajectory is continued unless dt, saveEach or particleSaveEach is changed.
+ * Then new files named after the checkpoint are written.
+ *
+ * Test particles, which feel gravity but have no mass, are added with
+ * -particles from a file like the systemfile. They are written to their own
+ * file, once per -particleSaveEach saved steps. A restarted run has the
+ * particles of its checkpoint, so -particles can not be given with -restart.
+ *
+ * With -monitor energy, angular momentum and the barycentre are sampled every
+ * n steps and their drift logged to MONITOR_OUTPUT. With -maxDrift a relative
+ * drift of energy or angular momentum above the given value is reported, and
+ * with -abortOnDrift the run is then stopped.
+ *
+ * With -elements the semi-major axis, eccentricity and period of every object
+ * are written to ELEMENTS_OUTPUT every n steps instead of the trajectory.
+ * They are of the orbit around the first object, or the object given by
+ * -primary, which may also be barycentre. With -elementStats the smallest,
+ * largest and mean of each are written to ELEMENT_STATS_OUTPUT when done.
+ * A restarted run continues the elements of its checkpoint unless n or the
+ * primary is changed.
+ *
+ * With -parareal the run is split in the given number of time slices, run in
+ * parallel and corrected by a coarse Verlet run with step -coarseDt (default
+ * PARAREAL_COARSE_FACTOR times dt) until slice ends change less than
+ * -defectTol, or -maxIterations iterations are done (default as many as
+ * slices). No trajectory is written, and defect and speedup of each
+ * iteration go to PARAREAL_OUTPUT. The final state is checkpointed if
+ * -checkpoint is given.
+ *
+ * With -ensemble the system is instead run once for each member listed in the
+ * given file, in parallel, and only a summary of each is written to
+ * ENSEMBLE_OUTPUT.
  *
  * Usage:
- *   ./<exe> <dt> <T> <systemfile>
+ *   ./<exe> <dt> <T> <systemfile> [-method rk4/rk38/ssprk3/rk5/verlet/yoshida4/yoshida6/wh/dopri] [-tol <tolerance>] [-saveEach <n>] [-checkpoint <file>] [-checkpointEvery <n>] [-restart] [-ensemble <file>] [-particles <file>] [-particleSaveEach <n>] [-monitor <n>] [-maxDrift <drift>] [-abortOnDrift] [-parareal <slices>] [-coarseDt <dt>] [-defectTol <tolerance>] [-maxIterations <n>] [-elements <n>] [-primary <id>/barycentre] [-elementStats]
  */
 int main(int argc, char* argv[]) {
-  if (argc != 4) {
+  if (argc < 4) {
     cout << "Need step size and number of steps pluss file to fetch system from." << endl;
+    cout << "Usage: ./<exe> <dt> <T> <systemfile> [-method rk4/rk38/ssprk3/rk5/verlet/yoshida4/yoshida6/wh/dopri] [-tol <tolerance>] [-saveEach <n>] [-checkpoint <file>] [-checkpointEvery <n>] [-restart] [-ensemble <file>] [-particles <file>] [-particleSaveEach <n>] [-monitor <n>] [-maxDrift <drift>] [-abortOnDrift] [-parareal <slices>] [-coarseDt <dt>] [-defectTol <tolerance>] [-maxIterations <n>] [-elements <n>] [-primary <id>/barycentre] [-elementStats]" << endl;
     return 1;
   }
 
-  double dt = atof(argv[1]);
-  double T = atof(argv[2]);
-  double t = 0;
+  RunSettings settings;
+  settings.dt = atof(argv[1]);
+  settings.T = atof(argv[2]);
 
   string infile = argv[3];
 
-  SolarSystem mySystem = SolarSystem(infile);
+  // Optional arguments
+  settings.method = RK4;
+  settings.methodGiven = false;
+  settings.tolerance = 1e-10;
+  settings.toleranceGiven = false;
+  settings.saveEach = 1;
+  settings.checkpointEvery = CHECKPOINT_EVERY;
+  settings.restart = false;
+  settings.particleSaveEach = 0;
+  settings.monitorEach = 0;
+  settings.maxDrift = 0;
+  settings.abortOnDrift = false;
+  settings.parareal.slices = 0;
+  settings.parareal.coarseDt = PARAREAL_COARSE_FACTOR * settings.dt;
+  settings.parareal.tolerance = PARAREAL_TOLERANCE;
+  settings.parareal.maxIterations = 0;
+  settings.elementsEach = 0;
+  settings.elementStats = false;
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i],"-method") == 0 && i+1 < argc) {
+      if (strcmp(argv[i+1],"rk4") == 0) {
+        settings.method = RK4;
+      } else if (strcmp(argv[i+1],"verlet") == 0) {
+        settings.method = VERLET;
+      } else if (strcmp(argv[i+1],"yoshida4") == 0) {
+        settings.method = YOSHIDA4;
+      } else if (strcmp(argv[i+1],"yoshida6") == 0) {
+        settings.method = YOSHIDA6;
+      } else if (strcmp(argv[i+1],"wh") == 0) {
+        settings.method = WISDOM_HOLMAN;
+      } else if (strcmp(argv[i+1],"dopri") == 0) {
+        settings.method = DORMAND_PRINCE;
+      } else if (strcmp(argv[i+1],"rk38") == 0) {
+        settings.method = RK38;
+      } else if (strcmp(argv[i+1],"ssprk3") == 0) {
+        settings.method = SSPRK3;
+      } else if (strcmp(argv[i+1],"rk5") == 0) {
+        settings.method = RK5;
+      } else {
+        cout << "Unknown method: " << argv[i+1] << endl;
+        return 1;
+      }
+      settings.methodGiven = true;
+      i++;
+    } else if (strcmp(argv[i],"-tol") == 0 && i+1 < argc) {
+      settings.tolerance = atof(argv[i+1]);
+      settings.toleranceGiven = true;
+      i++;
+    } else if (strcmp(argv[i],"-saveEach") == 0 && i+1 < argc) {
+      settings.saveEach = atoi(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-checkpoint") == 0 && i+1 < argc) {
+      settings.checkpoint = argv[i+1];
+      i++;
+    } else if (strcmp(argv[i],"-checkpointEvery") == 0 && i+1 < argc) {
+      settings.checkpointEvery = atol(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-restart") == 0) {
+      settings.restart = true;
+    } else if (strcmp(argv[i],"-ensemble") == 0 && i+1 < argc) {
+      settings.ensemble = argv[i+1];
+      i++;
+    } else if (strcmp(argv[i],"-particles") == 0 && i+1 < argc) {
+      settings.particles = argv[i+1];
+      i++;
+    } else if (strcmp(argv[i],"-particleSaveEach") == 0 && i+1 < argc) {
+      settings.particleSaveEach = atoi(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-monitor") == 0 && i+1 < argc) {
+      settings.monitorEach = atoi(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-maxDrift") == 0 && i+1 < argc) {
+      settings.maxDrift = atof(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-abortOnDrift") == 0) {
+      settings.abortOnDrift = true;
+    } else if (strcmp(argv[i],"-parareal") == 0 && i+1 < argc) {
+      settings.parareal.slices = atoi(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-coarseDt") == 0 && i+1 < argc) {
+      settings.parareal.coarseDt = atof(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-defectTol") == 0 && i+1 < argc) {
+      settings.parareal.tolerance = atof(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-maxIterations") == 0 && i+1 < argc) {
+      settings.parareal.maxIterations = atoi(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-elements") == 0 && i+1 < argc) {
+      settings.elementsEach = atoi(argv[i+1]);
+      i++;
+    } else if (strcmp(argv[i],"-primary") == 0 && i+1 < argc) {
+      settings.primary = argv[i+1];
+      i++;
+    } else if (strcmp(argv[i],"-elementStats") == 0) {
+      settings.elementStats = true;
+    }
+  }
 
-  while (t < T) {
-    mySystem.advance(dt);
-    t += dt;
+  if (settings.restart && !settings.particles.empty()) {
+    cout << "Test particles can not be added to a restarted run, it has "
+      << "those of the checkpoint." << endl;
+    return 1;
   }
 
-  mySystem.close();
+  if (settings.parareal.slices > 0 && settings.parareal.coarseDt <= 0) {
+    cout << "Parareal needs a positive coarse step, got -coarseDt "
+      << settings.parareal.coarseDt << endl;
+    return 1;
+  }
+  if (settings.parareal.maxIterations < 0) {
+    cout << "-maxIterations can not be negative." << endl;
+    return 1;
+  }
+
+  // A threshold needs samples to check
+  if (settings.maxDrift > 0 && settings.monitorEach == 0) {
+    settings.monitorEach = MONITOR_EVERY;
+  }
+
+  // Dimensionality is given by the systemfile or checkpoint
+  int dimensionality;
+  if (settings.restart) {
+    dimensionality = readCheckpointDimensionality(infile);
+    if (dimensionality == 0) {
+      cout << "Could not read checkpoint: " << infile << endl;
+      return 1;
+    }
+  } else {
+    dimensionality = readDimensionality(infile);
+  }
+
+  if (dimensionality == 2) {
+    simulate<2>(infile,settings);
+  } else if (dimensionality == 3) {
+    simulate<3>(infile,settings);
+  } else {
+    cout << "Systemfile must have 2 or 3 dimensions." << endl;
+    return 1;
+  }
 
-  cout << "Finished simulation." << endl;
   return 0;
 }
@@ -0,0 +1,241 @@
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <armadillo>
+
+#include "SolarSystem.hpp"
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Constants
+ */
+const string OUTPUT_FILE = "../data/workPrecision.dat";
+const double DT_MAX = 1e-2;             // Largest step tried
+const int NUM_DT = 8;                   // Steps tried, each half the last
+const double TOL_MAX = 1e-4;            // Largest tolerance of dopri
+const int NUM_TOL = 8;                  // Tolerances tried, each 1/10 the last
+const double REFERENCE_DT = DT_MAX / 512;  // A quarter of the smallest step
+const double MIN_TIME = 0.05;           // Runs repeated to last at least this
+const double TARGETS[3] = {1e-3, 1e-6, 1e-9};   // Phase errors to meet
+
+/*
+ * The schemes compared, with their names on the commandline of the
+ * simulation.
+ */
+const int NUM_METHODS = 9;
+const IntegrationMethod METHODS[NUM_METHODS] = {RK4, RK38, SSPRK3, RK5, VERLET,
+  YOSHIDA4, YOSHIDA6, WISDOM_HOLMAN, DORMAND_PRINCE};
+const char* METHOD_NAMES[NUM_METHODS] = {"rk4", "rk38", "ssprk3", "rk5",
+  "verlet", "yoshida4", "yoshida6", "wh", "dopri"};
+
+/*
+ * Cost and accuracy of one run.
+ */
+struct WorkPrecision {
+  int method;           // Index in METHODS
+  double dt;            // Step, mean step for the adaptive scheme
+  double tolerance;     // Of the adaptive scheme, else 0
+  long forceEvaluations;
+  double wallTime;      // Mean over repeats
+  double energyError;   // Relative change of total energy at T
+  double phaseError;    // Largest angle off the reference at T
+};
+
+/*
+ * Angle between two vectors. Found from the distance between the unit
+ * vectors, which stays accurate for small angles.
+ *
+ * @return The angle in radians.
+ */
+template <int D>
+double angleBetween(vec::fixed<D> a, vec::fixed<D> b) {
+  double chord = norm(a / norm(a) - b / norm(b));
+  return 2*asin(min(0.5*chord,1.0));
+}
+
+/*
+ * Largest error of the orbital phase of any object, seen from the first
+ * object, compared to the reference.
+ *
+ * @param system The system at T.
+ * @param reference Positions at T relative to the first object.
+ * @return The error in radians.
+ */
+template <int D>
+double phaseError(SolarSystem<D>& system,
+    vector<vec::fixed<D> >& reference) {
+  double error = 0;
+  vec::fixed<D> centre = system.getObject(0).getPos();
+  for (int i = 1; i < system.getNoOfObjects(); i++) {
+    vec::fixed<D> r = system.getObject(i).getPos() - centre;
+    error = max(error,angleBetween<D>(r,reference[i]));
+  }
+  return error;
+}
+
+/*
+ * Runs a copy of the base system to T, repeated until MIN_TIME has passed so
+ * the time of short runs can be measured.
+ *
+ * @param base The system at t = 0.
+ * @param method The scheme.
+ * @param dt Step. For the adaptive scheme the system is advanced to T at
+ * once, and steps are chosen from the tolerance.
+ * @param tolerance Of the adaptive scheme.
+ * @param T Time to simulate to.
+ * @param system Holds the run at T when done.
+ * @return Mean wall time of one run.
+ */
+template <int D>
+double timeRun(SolarSystem<D>& base, IntegrationMethod method, double dt,
+    double tolerance, double T, SolarSystem<D>& system) {
+  long steps = method == DORMAND_PRINCE ? 1 : (long) round(T/dt);
+  double h = T/steps;
+
+  double elapsed = 0;
+  int repeats = 0;
+  while (elapsed < MIN_TIME) {
+    system = base;
+    system.setIntegrationMethod(method);
+    system.setTolerance(tolerance);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (long n = 0; n < steps; n++) {
+      system.advance(h);
+    }
+    elapsed += chrono::duration<double>(chrono::steady_clock::now() -
+        start).count();
+    repeats++;
+  }
+
+  return elapsed / repeats;
+}
+
+/*
+ * Runs every scheme on one system for a range of steps, and dopri for a
+ * range of tolerances. Errors are against rk5 with REFERENCE_DT.
+ * Writes one line per run to the output file, and then the cheapest run
+ * meeting each of the TARGETS.
+ *
+ * @param systemfile The system.
+ * @param T Time to simulate to.
+ * @param output Open output file.
+ */
+template <int D>
+void benchmark(string systemfile, double T, FILE* output) {
+  SolarSystem<D> base(systemfile);
+  SolarSystem<D> system;
+  double energy0 = base.getEnergy();
+
+  timeRun(base,RK5,REFERENCE_DT,0.0,T,system);
+  vector<vec::fixed<D> > reference(system.getNoOfObjects());
+  for (int i = 0; i < system.getNoOfObjects(); i++) {
+    reference[i] = system.getObject(i).getPos() - system.getObject(0).getPos();
+  }
+
+  vector<WorkPrecision> runs;
+  for (int k = 0; k < NUM_METHODS; k++) {
+    int numRuns = METHODS[k] == DORMAND_PRINCE ? NUM_TOL : NUM_DT;
+    for (int j = 0; j < numRuns; j++) {
+      WorkPrecision run;
+      run.method = k;
+      run.dt = DT_MAX / pow(2.0,j);
+      run.tolerance = 0;
+      if (METHODS[k] == DORMAND_PRINCE) {
+        run.tolerance = TOL_MAX / pow(10.0,j);
+      }
+
+      run.wallTime = timeRun(base,METHODS[k],run.dt,run.tolerance,T,system);
+      run.forceEvaluations = system.getNoOfForceEvaluations();
+      run.energyError = fabs((system.getEnergy() - energy0) / energy0);
+      run.phaseError = phaseError<D>(system,reference);
+      if (METHODS[k] == DORMAND_PRINCE) {
+        run.dt = T / system.getNoOfAcceptedSteps();
+      }
+      runs.push_back(run);
+
+      fprintf(output,"%s %s %.6e %.1e %ld %.6e %.6e %.6e\n",
+          systemfile.c_str(),METHOD_NAMES[k],run.dt,run.tolerance,
+          run.forceEvaluations,run.wallTime,run.energyError,run.phaseError);
+    }
+  }
+
+  cout << systemfile << ", T = " << T << ":" << endl;
+  for (int l = 0; l < 3; l++) {
+    int best = -1;
+    for (size_t r = 0; r < runs.size(); r++) {
+      if (runs[r].phaseError <= TARGETS[l] &&
+          (best < 0 || runs[r].wallTime < runs[best].wallTime)) {
+        best = r;
+      }
+    }
+
+    if (best < 0) {
+      printf("  phase error %.0e: not met\n",TARGETS[l]);
+    } else {
+      WorkPrecision& run = runs[best];
+      printf("  phase error %.0e: %-8s dt %.2e  %8ld force evaluations  "
+          "%.2e s\n",TARGETS[l],METHOD_NAMES[run.method],run.dt,
+          run.forceEvaluations,run.wallTime);
+    }
+  }
+}
+
+/*
+ * Benchmark of all integration schemes. Each system is run to T with a range
+ * of steps, and the wall time, force evaluations, and errors of energy and
+ * orbital phase at T are written to OUTPUT_FILE as a work-precision table.
+ * For each system the cheapest run meeting a few phase errors is printed.
+ *
+ * Systems are given as pairs of systemfile and T. Default is the Sun-Earth,
+ * Sun-Earth-Moon and solar systems in `data`.
+ *
+ * Usage:
+ *   ./<exe> [<systemfile> <T>]...
+ */
+int main(int argc, char* argv[]) {
+  vector<string> systemfiles;
+  vector<double> times;
+  for (int i = 1; i+1 < argc; i += 2) {
+    systemfiles.push_back(argv[i]);
+    times.push_back(atof(argv[i+1]));
+  }
+  if (systemfiles.empty()) {
+    systemfiles.push_back("../data/sunEarthSystemAU.dat");
+    times.push_back(1);
+    systemfiles.push_back("../data/sunEarthMoon.dat");
+    times.push_back(1);
+    systemfiles.push_back("../data/solarSystemAU.dat");
+    times.push_back(10);
+  }
+
+  FILE* output = fopen(OUTPUT_FILE.c_str(),"w");
+  if (output == NULL) {
+    cout << "Could not open output: " << OUTPUT_FILE << endl;
+    return 1;
+  }
+  fprintf(output,"#syntax: system method dt tolerance forceEvaluations "
+      "wallTime energyError phaseError\n");
+
+  for (size_t s = 0; s < systemfiles.size(); s++) {
+    int dimensionality = readDimensionality(systemfiles[s]);
+    if (dimensionality == 2) {
+      benchmark<2>(systemfiles[s],times[s],output);
+    } else if (dimensionality == 3) {
+      benchmark<3>(systemfiles[s],times[s],output);
+    } else {
+      cout << "Systemfile must have 2 or 3 dimensions: " << systemfiles[s]
+        << endl;
+      return 1;
+    }
+    fflush(output);
+  }
+
+  fclose(output);
+  return 0;
+}
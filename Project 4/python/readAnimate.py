@@ -4,79 +4,115 @@
 from matplotlib import pyplot as plt
 from closedForm import cfs
 import numpy as np
-import sys,re,os
+import sys,os,struct
 
 """Classes"""
 class DiffusionProblem(object):
     """
+    The states stored of a run. Savefiles are binary, and the frames are
+    memory mapped, so only the states used are read from disk. Text
+    savefiles of older runs are also read.
     """
     def __init__(self, datafile):
+        """
+        Reads the header, then maps the frames following it.
+
+        @param datafile The savefile.
+        """
         self.path = datafile
 
-    def animate(self):
-        inData = open(self.path,'r')
+        inData = open(datafile,'rb')
+        if inData.read(8) != b'DIFFUS01':
+            inData.close()
+            self._readText()
+            return
 
-        plt.ion()
+        length = struct.unpack('i',inData.read(4))[0]
+        self.method = inData.read(length)
+        self.T,self.dt,self.dx = struct.unpack('3d',inData.read(24))
+        nx,ny,nz,self.saveEach = struct.unpack('4i',inData.read(16))
+        self.x = np.fromfile(inData, dtype=np.float64, count=nx)
 
-        fig = plt.figure()
-        ax = fig.add_subplot(111)
-        ax.grid('on')
+        offset = inData.tell()
+        inData.close()
+
+        # Each frame is t followed by all values, x fastest
+        frameSize = 1 + nx*ny*nz
+        numFrames = (os.path.getsize(datafile) - offset) // (8*frameSize)
+        self._frames = np.memmap(datafile, dtype=np.float64, mode='r',
+                offset=offset, shape=(numFrames,frameSize))
+
+        # Axes of a state are z, y, x, and only those longer than one
+        self.shape = tuple(n for n in (nz,ny,nx) if n > 1)
+        self.t = self._frames[:,0]
 
+    def _readText(self):
+        """
+        Reads a text savefile, with a header and then one state per line for
+        every step.
+        """
+        inData = open(self.path,'r')
+
+        states = []
         pastHeader = False
-        firstFrame = True
-        
         for line in inData:
             if not pastHeader:
                 if line.startswith('#/HEADER#'):
                     pastHeader = True
                 if line.startswith('x:'):
-                    x = np.asarray([float(e) for e in line.strip().split()[1:]])
+                    self.x = np.asarray([float(e) for e in line.strip().split()[1:]])
+                if line.startswith('dt:'):
+                    self.dt = float(line.split()[1])
             else:
-                u = np.asarray([float(e) for e in line.strip().split()])
+                states.append([float(e) for e in line.strip().split()])
 
-                if firstFrame:
-                    graph, = ax.plot(x, u)
-                    firstFrame = False
-                else:
-                    graph.set_ydata(u)
+        inData.close()
 
-                plt.draw()
+        self._frames = np.zeros((len(states),1 + len(self.x)))
+        self._frames[:,0] = self.dt*np.arange(len(states))
+        self._frames[:,1:] = states
+        self.shape = (len(self.x),)
+        self.t = self._frames[:,0]
 
-        plt.ioff()
-        plt.show()
-
-        inData.close()
+    def frame(self, n):
+        """
+        @param n Index of frame.
+        @return State at frame n, shaped as the grid.
+        """
+        return self._frames[n,1:].reshape(self.shape)
 
-    def getState(self, t):
+    def __len__(self):
+        """
+        Length means number of frames.
         """
-        Returns state at time t.
+        return self._frames.shape[0]
 
-        @param t Time of state.
+    def animate(self):
+        """
+        Plots the states of a rod one after the other.
         """
-        tCur = 0
+        plt.ion()
 
-        dtfile = open(self.path, 'r')
-        dt = float(re.search(r'dt: (.+)', dtfile.read()).groups(0)[0])
-        dtfile.close()
+        fig = plt.figure()
+        ax = fig.add_subplot(111)
+        ax.grid('on')
 
-        inData = open(self.path, 'r')
+        graph, = ax.plot(self.x, self.frame(0))
+        for n in range(1,len(self)):
+            graph.set_ydata(self.frame(n))
+            plt.draw()
 
-        pastHeader = False
-        for line in inData:
-            if tCur >= t:
-                break
-            if not pastHeader:
-                if line.startswith('#/HEADER#'):
-                    pastHeader = True
-                if line.startswith('x:'):
-                    x = np.asarray([float(e) for e in line.strip().split()[1:]])
-            else:
-                u = np.asarray([float(e) for e in line.strip().split()])
-                tCur += dt
+        plt.ioff()
+        plt.show()
 
-        inData.close()
+    def getState(self, t):
+        """
+        Returns the stored state nearest time t.
 
-        return x,u
+        @param t Time of state.
+        """
+        n = np.argmin(np.abs(self.t - t))
+        return self.x,self.frame(n)
 
 def compareCases(t1=17*5e-3, t2=90*5e-3):
     """
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "DiffusionWriter.hpp"
+
+using namespace std;
+
+/*
+ * Size of each of the two buffers. Frames larger than this are split.
+ */
+const long BUFFER_BYTES = 1 << 22;
+
+/*
+ * Opens the file, writes the header and starts the writer thread.
+ *
+ * @param output Path of the file, and which states to store.
+ * @param method Name of the scheme.
+ * @param T Runtime.
+ * @param dt Time step.
+ * @param dx Step size.
+ * @param x The nx points of the grid.
+ * @param nx Points along x.
+ * @param ny Points along y, 1 for a rod.
+ * @param nz Points along z, 1 for a rod or plate.
+ */
+DiffusionWriter :: DiffusionWriter(OutputSettings& output, string method,
+    double T, double dt, double dx, const double* x, int nx, int ny, int nz) {
+  saveEach = output.saveEach > 0 ? output.saveEach : 0;
+  saveTimes = output.saveTimes;
+  sort(saveTimes.begin(),saveTimes.end());
+  nextTime = 0;
+  this->dt = dt;
+  counter = 0;
+  frames = 0;
+  active = 0;
+  filled = 0;
+  pendingValues = 0;
+  pending = false;
+  stopping = false;
+  failed = false;
+  filename = output.filepath;
+
+  file = fopen(filename.c_str(),"wb");
+  if (file == NULL) {
+    cout << "Could not open savefile: " << filename << endl;
+    exit(1);
+  }
+
+  int length = method.size();
+  bool written = fwrite("DIFFUS01",1,8,file) == 8;
+  written &= fwrite(&length,sizeof(int),1,file) == 1;
+  written &= fwrite(method.c_str(),1,length,file) == (size_t) length;
+  written &= fwrite(&T,sizeof(double),1,file) == 1;
+  written &= fwrite(&dt,sizeof(double),1,file) == 1;
+  written &= fwrite(&dx,sizeof(double),1,file) == 1;
+  written &= fwrite(&nx,sizeof(int),1,file) == 1;
+  written &= fwrite(&ny,sizeof(int),1,file) == 1;
+  written &= fwrite(&nz,sizeof(int),1,file) == 1;
+  written &= fwrite(&saveEach,sizeof(int),1,file) == 1;
+  written &= fwrite(x,sizeof(double),nx,file) == (size_t) nx;
+  checkWrite(written);
+
+  frameSize = 1 + (long) nx*ny*nz;
+  buffers[0].resize(BUFFER_BYTES / sizeof(double));
+  buffers[1].resize(BUFFER_BYTES / sizeof(double));
+
+  writer = thread(&DiffusionWriter::writerLoop,this);
+}
+
+DiffusionWriter :: ~DiffusionWriter() {
+  close();
+}
+
+/*
+ * Finds if the state of a step is to be stored. The first one always is,
+ * and then every saveEach-th, and the one nearest each requested time.
+ * Must be called once for every step, in order, unless addFrame is.
+ *
+ * @param t Time of state.
+ * @param last True for the last state of the run.
+ */
+bool DiffusionWriter :: wanted(double t, bool last) {
+  bool store = last || counter == 0 ||
+    (saveEach > 0 && counter % saveEach == 0);
+  while (nextTime < saveTimes.size() && saveTimes[nextTime] < t + 0.5*dt) {
+    store = true;
+    nextTime++;
+  }
+  counter++;
+  return store;
+}
+
+/*
+ * Gives the state after a step, to be called for every step and for the
+ * initial state. Stores it if wanted.
+ *
+ * @param t Time of state.
+ * @param u All nx*ny*nz values.
+ * @param last True for the last state of the run, which is always stored.
+ */
+void DiffusionWriter :: addFrame(double t, const double* u, bool last) {
+  if (wanted(t,last)) {
+    storeFrame(t,u);
+  }
+}
+
+/*
+ * Stores a state, for steps found wanted. The state is copied, so u can be
+ * changed right after.
+ *
+ * @param t Time of state.
+ * @param u All nx*ny*nz values.
+ */
+void DiffusionWriter :: storeFrame(double t, const double* u) {
+  append(&t,1);
+  append(u,frameSize-1);
+  frames++;
+}
+
+/*
+ * Copies values into the active buffer, handing it over each time it is
+ * full.
+ *
+ * @param values Values to copy.
+ * @param n How many.
+ */
+void DiffusionWriter :: append(const double* values, long n) {
+  long bufferSize = buffers[active].size();
+  while (n > 0) {
+    long count = min(n,bufferSize - filled);
+    memcpy(&buffers[active][filled],values,count*sizeof(double));
+    filled += count;
+    values += count;
+    n -= count;
+
+    if (filled == bufferSize) {
+      handOver();
+    }
+  }
+}
+
+/*
+ * Gives the active buffer to the writer thread and starts filling the other
+ * one. Waits only if the writer is not done with the other one yet.
+ */
+void DiffusionWriter :: handOver() {
+  unique_lock<mutex> lock(lockMutex);
+  while (pending) {
+    changed.wait(lock);
+  }
+  checkWrite(!failed);
+
+  pendingValues = filled;
+  pending = true;
+  active = 1 - active;
+  filled = 0;
+
+  changed.notify_all();
+}
+
+/*
+ * Run by the writer thread. Writes buffers as they are handed over, until
+ * told to stop.
+ */
+void DiffusionWriter :: writerLoop() {
+  unique_lock<mutex> lock(lockMutex);
+
+  while (true) {
+    while (!pending && !stopping) {
+      changed.wait(lock);
+    }
+    if (!pending && stopping) {
+      return;
+    }
+
+    // Buffer being written is the one not active
+    int toWrite = 1 - active;
+    long numValues = pendingValues;
+
+    lock.unlock();
+    bool written = fwrite(&buffers[toWrite][0],sizeof(double),numValues,file)
+      == (size_t) numValues;
+    lock.lock();
+
+    failed |= !written;
+    pending = false;
+    changed.notify_all();
+  }
+}
+
+/*
+ * Writes what is left in the buffers, stops the writer thread and closes the
+ * file.
+ */
+void DiffusionWriter :: close() {
+  if (stopping) {
+    return;
+  }
+
+  if (filled > 0) {
+    handOver();
+  }
+
+  {
+    lock_guard<mutex> lock(lockMutex);
+    stopping = true;
+    changed.notify_all();
+  }
+  writer.join();
+
+  bool written = !failed;
+  written &= fclose(file) == 0;
+  file = NULL;
+  checkWrite(written);
+}
+
+/*
+ * Stops the program if a write failed, as the savefile is then incomplete.
+ *
+ * @param written False if a write failed.
+ */
+void DiffusionWriter :: checkWrite(bool written) {
+  if (!written) {
+    cout << "Could not write savefile: " << filename << endl;
+    exit(1);
+  }
+}
+
+/*
+ * @return Number of frames stored so far.
+ */
+long DiffusionWriter :: getNoOfFrames() {
+  return frames;
+}
@@ -0,0 +1,82 @@
+#ifndef DIFFUSIONWRITER_HPP
+#define DIFFUSIONWRITER_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * Which states of a run are stored, and where.
+ */
+struct OutputSettings {
+  std::string filepath;
+  int saveEach;                         // Store every saveEach-th step, 0 for none
+  std::vector<double> saveTimes;        // Also store the steps nearest these
+};
+
+/*
+ * Writes states of a diffusion run to one binary file. The first and last
+ * states are always stored, and in between only those asked for by the
+ * OutputSettings. Frames are copied into one of two buffers of fixed size,
+ * and full buffers are written by a background thread while the other one is
+ * filled, so the time loop does not wait for the disk. A frame may span
+ * buffers, so a grid larger than a buffer needs no more memory. A failed
+ * write stops the program.
+ *
+ * File layout, all little endian as written by the machine:
+ *   char[8]  "DIFFUS01"
+ *   int32    length of method name, then the name
+ *   double   T, dt, dx
+ *   int32    nx, ny, nz (1 for lower dimensions), saveEach
+ *   double   the nx points of the grid along x, the same along y and z
+ *   frames:  double t, then all nx*ny*nz values with x fastest
+ */
+class DiffusionWriter {
+  public:
+    DiffusionWriter(OutputSettings&,std::string,double,double,double,
+        const double*,int,int,int);
+    ~DiffusionWriter();
+
+    void addFrame(double,const double*,bool = false);
+    bool wanted(double,bool);
+    void storeFrame(double,const double*);
+    void close();
+
+    long getNoOfFrames();
+
+  private:
+    long frameSize;                     // Doubles in a frame
+    long frames,counter;
+
+    int saveEach;
+    std::vector<double> saveTimes;
+    size_t nextTime;                    // First of saveTimes not stored yet
+    double dt;
+
+    std::string filename;
+    FILE* file;
+
+    /*
+     * Two buffers, one is filled while the other is written.
+     */
+    std::vector<double> buffers[2];
+    int active;                         // Buffer being filled
+    long filled;                        // Values in active buffer
+    long pendingValues;                 // Values in buffer being written
+
+    std::thread writer;
+    std::mutex lockMutex;
+    std::condition_variable changed;
+    bool pending,stopping;
+    bool failed;                        // A write of the writer thread failed
+
+    void append(const double*,long);
+    void handOver();
+    void writerLoop();
+    void checkWrite(bool);
+};
+
+#endif // DIFFUSIONWRITER_HPP
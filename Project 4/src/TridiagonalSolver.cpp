@@ -0,0 +1,83 @@
+#include "TridiagonalSolver.hpp"
+
+using namespace std;
+
+/*
+ * Factors the matrix.
+ *
+ * @param n Number of unknowns.
+ * @param a Lower diagonal.
+ * @param b Diagonal.
+ * @param c Upper diagonal.
+ */
+TridiagonalSolver :: TridiagonalSolver(int n, double a, double b, double c) {
+  this->n = n;
+  lower = a;
+  upperPrime.resize(n);
+  inversePivot.resize(n);
+
+  inversePivot[0] = 1 / b;
+  upperPrime[0] = c * inversePivot[0];
+  for (int i = 1; i < n; i++) {
+    inversePivot[i] = 1 / (b - a*upperPrime[i-1]);
+    upperPrime[i] = c * inversePivot[i];
+  }
+}
+
+/*
+ * Solves the system in place.
+ *
+ * @param d Right hand side, n values. Set to the solution.
+ */
+void TridiagonalSolver :: solve(double* d) const {
+  const double* cp = upperPrime.data();
+  const double* m = inversePivot.data();
+
+  d[0] *= m[0];
+  for (int i = 1; i < n; i++) {
+    d[i] = (d[i] - lower*d[i-1]) * m[i];
+  }
+  for (int i = n-2; i >= 0; i--) {
+    d[i] -= cp[i]*d[i+1];
+  }
+}
+
+/*
+ * Solves many systems at once, in place. Element k of system b is
+ * d[k*stride + b], so the systems lie side by side and every elimination
+ * step is vectorized over them. Used for lines of a grid that are not
+ * contiguous.
+ *
+ * @param d Right hand sides, set to the solutions.
+ * @param stride Distance between element k and k+1 of a system.
+ * @param batch Number of systems.
+ */
+void TridiagonalSolver :: solveBatch(double* d, long stride, int batch) const {
+  const double* cp = upperPrime.data();
+  const double* m = inversePivot.data();
+  double a = lower;
+
+  double m0 = m[0];
+#pragma omp simd
+  for (int b = 0; b < batch; b++) {
+    d[b] *= m0;
+  }
+  for (int k = 1; k < n; k++) {
+    double* row = d + k*stride;
+    const double* previous = row - stride;
+    double mk = m[k];
+#pragma omp simd
+    for (int b = 0; b < batch; b++) {
+      row[b] = (row[b] - a*previous[b]) * mk;
+    }
+  }
+  for (int k = n-2; k >= 0; k--) {
+    double* row = d + k*stride;
+    const double* next = row + stride;
+    double ck = cp[k];
+#pragma omp simd
+    for (int b = 0; b < batch; b++) {
+      row[b] -= ck*next[b];
+    }
+  }
+}
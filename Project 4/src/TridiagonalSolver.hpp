@@ -0,0 +1,27 @@
+#ifndef TRIDIAGONALSOLVER_HPP
+#define TRIDIAGONALSOLVER_HPP
+
+#include <vector>
+
+/*
+ * Solves systems with a constant tridiagonal matrix of lower diagonal a,
+ * diagonal b and upper diagonal c. The matrix is factored once, by Gaussian
+ * elimination without pivoting, so each solve is one O(n) forward and back
+ * substitution. The matrix must be diagonally dominant, |b| > |a| + |c|.
+ */
+class TridiagonalSolver {
+  public:
+    TridiagonalSolver(int,double,double,double);
+
+    void solve(double*) const;
+    void solveBatch(double*,long,int) const;
+    int size() const { return n; }
+
+  private:
+    int n;
+    double lower;
+    std::vector<double> upperPrime;   // Upper diagonal after elimination
+    std::vector<double> inversePivot; // One over diagonal after elimination
+};
+
+#endif // TRIDIAGONALSOLVER_HPP
@@ -0,0 +1,280 @@
+#include <chrono>
+#include <vector>
+
+#include "diffusionADI.hpp"
+#include "TridiagonalSolver.hpp"
+
+using namespace arma;
+using namespace std;
+
+/*
+ * Constants
+ */
+const int TILE_LINES = 8;               // Lines along x solved together
+const int BATCH_WIDTH = 256;            // Lines along y or z solved together
+
+/*
+ * The sweeps below solve every line of inner points along one direction of
+ * a grid of nx*ny*nz points, stored with x fastest, so point (i,j,k) is at
+ * i + nx*(j + ny*k). A plane has nz = 1. The right hand side of each point
+ * is given by rhs, and the boundary points of g are moved to the right hand
+ * side of the points next to them. Lines are shared among OpenMP threads.
+ */
+
+/*
+ * Implicit sweep along x. Lines along x are contiguous, and the recursion of
+ * a solve runs along them, so it can not be vectorized. TILE_LINES lines are
+ * instead transposed into a tile where they lie side by side, solved
+ * together, and transposed back.
+ *
+ * @param rhs Gives the right hand side of the point at an index.
+ * @param g Holds the boundary values.
+ * @param out Set to the solution in the inner points. May be g.
+ * @param nx Points along x.
+ * @param ny Points along y.
+ * @param nz Points along z, 1 for a plane.
+ * @param h Weight of the implicit part, the off diagonals are -h.
+ * @param solver Factored matrix of a line.
+ */
+template <class RightHandSide>
+static void sweepX(const RightHandSide& rhs, const double* g, double* out,
+    int nx, int ny, int nz, double h, const TridiagonalSolver& solver) {
+  int kBegin = nz > 1 ? 1 : 0;
+  int kEnd = nz > 1 ? nz-1 : 1;
+  int numTiles = (ny - 2 + TILE_LINES - 1) / TILE_LINES;
+
+#pragma omp parallel
+  {
+    vector<double> tile((nx-2)*TILE_LINES);
+
+#pragma omp for collapse(2) schedule(static)
+    for (int k = kBegin; k < kEnd; k++) {
+      for (int n = 0; n < numTiles; n++) {
+        int j0 = 1 + n*TILE_LINES;
+        int lines = min(TILE_LINES,ny-1 - j0);
+
+        for (int l = 0; l < lines; l++) {
+          long p0 = nx*(j0 + l + (long) ny*k);
+          for (int i = 1; i < nx-1; i++) {
+            tile[(i-1)*TILE_LINES + l] = rhs(p0 + i);
+          }
+          tile[l] += h*g[p0];
+          tile[(nx-3)*TILE_LINES + l] += h*g[p0 + nx-1];
+        }
+
+        solver.solveBatch(tile.data(),TILE_LINES,lines);
+
+        for (int l = 0; l < lines; l++) {
+          long p0 = nx*(j0 + l + (long) ny*k);
+          for (int i = 1; i < nx-1; i++) {
+            out[p0 + i] = tile[(i-1)*TILE_LINES + l];
+          }
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Implicit sweep along y, or along z when stride is nx*ny. Neighbouring
+ * lines are next to each other in memory, so BATCH_WIDTH of them are solved
+ * in place, vectorized over the lines.
+ *
+ * @param rhs Gives the right hand side of the point at an index. May read
+ * out at that index only.
+ * @param g Holds the boundary values.
+ * @param out Set to the solution in the inner points. May be g.
+ * @param nx Points along x.
+ * @param ny Points along y.
+ * @param nz Points along z, 1 for a plane.
+ * @param stride nx to sweep along y, nx*ny to sweep along z.
+ * @param h Weight of the implicit part, the off diagonals are -h.
+ * @param solver Factored matrix of a line.
+ */
+template <class RightHandSide>
+static void sweepStrided(const RightHandSide& rhs, const double* g,
+    double* out, int nx, int ny, int nz, long stride, double h,
+    const TridiagonalSolver& solver) {
+  // Lines start on the first inner point of the direction swept, and are
+  // found from i and the other direction, o
+  bool alongY = stride == nx;
+  long oStride = alongY ? (long) nx*ny : nx;
+  int oBegin = alongY ? (nz > 1 ? 1 : 0) : 1;
+  int oEnd = alongY ? (nz > 1 ? nz-1 : 1) : ny-1;
+  int length = alongY ? ny : nz;
+  int numBatches = (nx - 2 + BATCH_WIDTH - 1) / BATCH_WIDTH;
+
+#pragma omp parallel for collapse(2) schedule(static)
+  for (int o = oBegin; o < oEnd; o++) {
+    for (int n = 0; n < numBatches; n++) {
+      int i0 = 1 + n*BATCH_WIDTH;
+      int width = min(BATCH_WIDTH,nx-1 - i0);
+      long p0 = i0 + o*oStride;
+
+      for (int m = 1; m < length-1; m++) {
+        long p = p0 + m*stride;
+#pragma omp simd
+        for (int b = 0; b < width; b++) {
+          out[p + b] = rhs(p + b);
+        }
+      }
+#pragma omp simd
+      for (int b = 0; b < width; b++) {
+        out[p0 + stride + b] += h*g[p0 + b];
+        out[p0 + (length-2)*stride + b] += h*g[p0 + (length-1)*stride + b];
+      }
+
+      solver.solveBatch(out + p0 + stride,stride,width);
+    }
+  }
+}
+
+/*
+ * Prints how many inner points were advanced per second.
+ */
+static void reportThroughput(string method, long cells, long steps,
+    double seconds) {
+  cout << method << ": " << steps << " steps of " << cells << " cells in "
+    << seconds << " s, " << cells*(double) steps / seconds
+    << " cell updates per second" << endl;
+}
+
+/*
+ * Peaceman-Rachford ADI on the unit square. Each step is half a step
+ * implicit in x and explicit in y, then half a step the other way round, so
+ * only tridiagonal systems along lines are solved. Second order and
+ * unconditionally stable. The boundary values are kept.
+ *
+ * @param dt Time step.
+ * @param T Runtime.
+ * @param dx Step size, in both directions.
+ * @param u Initial condition with the boundary values, x along rows. Set to
+ * the state at T.
+ * @param output Savefile, and which states to store.
+ */
+void peacemanRachfordDiffusion2D(double dt, double T, double dx, mat& u, OutputSettings output) {
+  int nx = u.n_rows;
+  int ny = u.n_cols;
+
+  // Time parameters
+  double t = 0;
+
+  // Physical constants
+  double D = 1;
+
+  double alpha = dt / (dx*dx);
+  double h = 0.5*D*alpha;
+
+  // State after the first half step, the boundary values stay
+  mat uHalf = u;
+
+  TridiagonalSolver solverX(nx-2,-h,1+2*h,-h);
+  TridiagonalSolver solverY(ny-2,-h,1+2*h,-h);
+
+  // Open savefile and write header
+  colvec x = linspace<colvec>(0, 1, nx);
+  DiffusionWriter writer(output,"PeacemanRachford",T,dt,dx,x.memptr(),nx,ny,1);
+  writer.addFrame(t,u.memptr());
+
+  double* now = u.memptr();
+  double* half = uHalf.memptr();
+  long steps = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  while (t < T) {
+    // Implicit in x, explicit in y
+    sweepX([&](long p) {
+        return now[p] + h*(now[p-nx] - 2*now[p] + now[p+nx]);
+      },now,half,nx,ny,1,h,solverX);
+
+    // Implicit in y, explicit in x
+    sweepStrided([&](long p) {
+        return half[p] + h*(half[p-1] - 2*half[p] + half[p+1]);
+      },now,now,nx,ny,1,nx,h,solverY);
+
+    t += dt;
+    steps++;
+    writer.addFrame(t,now,t >= T);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() -
+      start).count();
+  reportThroughput("PeacemanRachford",(long) (nx-2)*(ny-2),steps,seconds);
+
+  writer.close();
+}
+
+/*
+ * Douglas ADI on the unit cube. A step is first taken implicit in x and
+ * explicit in y and z, and then corrected to be implicit in y, and then in
+ * z. Crank-Nicolson weights are used, so it is second order and
+ * unconditionally stable. The boundary values are kept.
+ *
+ * @param dt Time step.
+ * @param T Runtime.
+ * @param dx Step size, in all directions.
+ * @param u Initial condition with the boundary values. Set to the state
+ * at T.
+ * @param output Savefile, and which states to store.
+ */
+void douglasDiffusion3D(double dt, double T, double dx, cube& u, OutputSettings output) {
+  int nx = u.n_rows;
+  int ny = u.n_cols;
+  int nz = u.n_slices;
+  long nxy = (long) nx*ny;
+
+  // Time parameters
+  double t = 0;
+
+  // Physical constants
+  double D = 1;
+
+  double r = D*dt / (dx*dx);
+  double h = 0.5*r;
+
+  // Buffer for the next state, the boundary values stay
+  cube uNext = u;
+
+  TridiagonalSolver solverX(nx-2,-h,1+2*h,-h);
+  TridiagonalSolver solverY(ny-2,-h,1+2*h,-h);
+  TridiagonalSolver solverZ(nz-2,-h,1+2*h,-h);
+
+  // Open savefile and write header
+  colvec x = linspace<colvec>(0, 1, nx);
+  DiffusionWriter writer(output,"Douglas",T,dt,dx,x.memptr(),nx,ny,nz);
+  writer.addFrame(t,u.memptr());
+
+  double* now = u.memptr();
+  double* next = uNext.memptr();
+  long steps = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  while (t < T) {
+    // Implicit in x, explicit in y and z
+    sweepX([&](long p) {
+        return now[p] + h*(now[p-1] - 2*now[p] + now[p+1])
+          + r*(now[p-nx] + now[p+nx] + now[p-nxy] + now[p+nxy] - 4*now[p]);
+      },now,next,nx,ny,nz,h,solverX);
+
+    // Correct to implicit in y
+    sweepStrided([&](long p) {
+        return next[p] - h*(now[p-nx] - 2*now[p] + now[p+nx]);
+      },now,next,nx,ny,nz,nx,h,solverY);
+
+    // Correct to implicit in z
+    sweepStrided([&](long p) {
+        return next[p] - h*(now[p-nxy] - 2*now[p] + now[p+nxy]);
+      },now,next,nx,ny,nz,nxy,h,solverZ);
+
+    swap(now,next);
+    t += dt;
+    steps++;
+    writer.addFrame(t,now,t >= T);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() -
+      start).count();
+  reportThroughput("Douglas",(long) (nx-2)*(ny-2)*(nz-2),steps,seconds);
+
+  writer.close();
+
+  if (now != u.memptr()) {
+    u = uNext;
+  }
+}
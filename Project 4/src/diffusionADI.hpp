@@ -0,0 +1,6 @@
+#include <armadillo>
+
+#include "DiffusionWriter.hpp"
+
+void peacemanRachfordDiffusion2D(double dt, double T, double dx, arma::mat& u, OutputSettings output);
+void douglasDiffusion3D(double dt, double T, double dx, arma::cube& u, OutputSettings output);
@@ -1,21 +1,130 @@
+#include <cstring>
+#include <vector>
+
 #include "diffusionIntegration.hpp"
+#include "TridiagonalSolver.hpp"
 
 using namespace arma;
 using namespace std;
 
 /*
+ * Constants
+ */
+const int PARALLEL_MIN_POINTS = 100000; // Fewer points are not worth threads
+const int TIME_BLOCK = 64;              // Steps taken per tile of a rod
+const int TILE_POINTS = 8192;           // Points of a tile of a rod
+const int TIME_BLOCK_2D = 16;           // Steps taken per tile of a plate
+const int TILE_WIDTH = 128;             // Points along x of a tile of a plate
+const int TILE_HEIGHT = 128;            // Points along y of a tile of a plate
+
+/*
+ * Forward Euler update of point i of a rod,
+ *   u_i + r*(u_{i-1} - 2u_i + u_{i+1}),
+ * and of point p of a plate with rows of nx points. Shared by the tiled and
+ * untiled loops, so they give the same result bit for bit.
+ */
+static inline double forwardEulerPoint(const double* u, int i, double r) {
+  return u[i] + r*(u[i-1] - 2*u[i] + u[i+1]);
+}
+
+static inline double forwardEulerPoint2D(const double* u, long p, long nx,
+    double r) {
+  return u[p] + r*(u[p-1] + u[p+1] + u[p-nx] + u[p+nx] - 4*u[p]);
+}
+
+/*
+ * One forward Euler step of the inner points. The boundary points are not
+ * touched. The loop is vectorized, and on fine grids shared among OpenMP
+ * threads.
+ *
+ * @param u State now.
+ * @param uNew Set to the state after the step. Must not overlap u.
+ * @param nx Number of points.
+ * @param r Diffusion constant times dt / dx^2.
+ */
+static void forwardEulerStep(const double* __restrict__ u,
+    double* __restrict__ uNew, int nx, double r) {
+#pragma omp parallel for simd schedule(static) if (nx > PARALLEL_MIN_POINTS)
+  for (int i = 1; i < nx-1; i++) {
+    uNew[i] = forwardEulerPoint(u,i,r);
+  }
+}
+
+/*
+ * Several forward Euler steps of the inner points, by temporal tiling. A
+ * step streams the whole rod through memory, so instead the rod is cut in
+ * tiles of TILE_POINTS points, and each tile is taken all the steps while it
+ * is in cache. A tile is read with steps points more on each side, and the
+ * points that are right shrink by one on each side every step, so the
+ * points computed form a trapezoid in space and time. Neighbouring
+ * trapezoids overlap, which costs 2*steps/TILE_POINTS extra work.
+ *
+ * @param u State now.
+ * @param uNew Set to the state after the steps. Must not overlap u.
+ * @param nx Number of points.
+ * @param r Diffusion constant times dt / dx^2.
+ * @param steps Number of steps, at most TIME_BLOCK.
+ */
+static void forwardEulerSteps(const double* __restrict__ u,
+    double* __restrict__ uNew, int nx, double r, int steps) {
+  int numTiles = (nx - 2 + TILE_POINTS - 1) / TILE_POINTS;
+
+#pragma omp parallel if (nx > PARALLEL_MIN_POINTS)
+  {
+    vector<double> tiles[2];
+    tiles[0].resize(TILE_POINTS + 2*TIME_BLOCK + 2);
+    tiles[1].resize(TILE_POINTS + 2*TIME_BLOCK + 2);
+
+#pragma omp for schedule(static)
+    for (int n = 0; n < numTiles; n++) {
+      // Points of the tile, and of the rod they depend on
+      int i0 = 1 + n*TILE_POINTS;
+      int i1 = min(i0 + TILE_POINTS,nx-1);
+      int lo = max(0,i0 - steps);
+      int hi = min(nx,i1 + steps);
+
+      // Tiles start at point lo. Points outside those computed are only
+      // read from the first, but the boundary points of the rod are read
+      // every step, so they are put in both
+      double* now = tiles[0].data();
+      double* next = tiles[1].data();
+      memcpy(now,u + lo,(hi - lo)*sizeof(double));
+      next[0] = now[0];
+      next[hi-lo-1] = now[hi-lo-1];
+
+      for (int s = 0; s < steps; s++) {
+        int from = lo == 0 ? 1 : s + 1;
+        int to = hi == nx ? nx-1 - lo : hi - lo - s - 1;
+#pragma omp simd
+        for (int i = from; i < to; i++) {
+          next[i] = forwardEulerPoint(now,i,r);
+        }
+        swap(now,next);
+      }
+
+      memcpy(uNew + i0,now + i0 - lo,(i1 - i0)*sizeof(double));
+    }
+  }
+}
+
+/*
+ * The three point stencil is applied directly, with two buffers swapped,
+ * so memory and work per step are O(nx). Steps between the states stored
+ * are taken TIME_BLOCK at a time by temporal tiling.
+ *
  * @param dt Time step.
  * @param T Runtime.
  * @param dx Step size.
  * @param ic Initial condition.
  * @param bc Boundary conditions.
- * @param filepath Path to savefile.
+ * @param output Savefile, and which states to store.
+ * @param tiled False to take one step at a time.
  */
-void forwardEulerDiffusion(double dt, double T, double dx, colvec ic, colvec bc, string filepath) {
+void forwardEulerDiffusion(double dt, double T, double dx, colvec ic, colvec bc, OutputSettings output, bool tiled) {
   // Spatial parameters
   double a = 0;
   double b = 1;
-  int nx = b / dx;
+  int nx = ic.size();
   colvec x = linspace<colvec>(a, b, nx);
 
   // Time parameters
@@ -24,75 +133,276 @@ void forwardEulerDiffusion(double dt, double T, double dx, colvec ic, colvec bc,
   // Physical constants
   double D = 1;
 
-  // Create central difference matrix
-  mat ddx2 = zeros(x.size(), x.size());
-  ddx2.diag(0).fill(-2);
-  ddx2.diag(1).fill(1);
-  ddx2.diag(-1).fill(1);
-
   // Check on alpha status
   double alpha = dt / (dx*dx);
-  if (alpha > 0.5) {
+  if (D*alpha > 0.5) {
     cout << "Bad choice of steps sizes." << endl;
   }
 
-  // Open savefile
-  ofstream outfile;
-  outfile.open(filepath.c_str());
-
-  // Write header
-  outfile << "#HEADER#" << endl;
-  outfile << "Method: ForwardEuler" << endl;
-  outfile << "T: " << T << endl << "dt: " << dt << endl;
-  outfile << "dx: " << dx << endl;
-  outfile << "x: ";
-  for (int i = 0; i < nx; i++) { outfile << x(i) << " "; }
-  outfile << endl;
-  outfile << "#/HEADER#" << endl;
+  // Open savefile and write header
+  DiffusionWriter writer(output,"ForwardEuler",T,dt,dx,x.memptr(),nx,1,1);
 
-  // Initial state
-  colvec u = D*alpha*ddx2*ic;
+  // Initial state, and a buffer for the next
+  colvec u = ic;
+  colvec uNext = ic;
 
-  // Add boundary conditions
-  u(0) = bc(0);
-  u(u.size()-1) = bc(1);
+  // Add boundary conditions, they stay in both buffers
+  u(0) = uNext(0) = bc(0);
+  u(nx-1) = uNext(nx-1) = bc(1);
 
   // Save initial state
-  for (int i = 0; i < nx; i++) { outfile << u(i) << " "; }
-  outfile << endl;
+  writer.addFrame(t,u.memptr());
 
+  double* now = u.memptr();
+  double* next = uNext.memptr();
+  int maxSteps = tiled ? TIME_BLOCK : 1;
   while (t < T) {
+    // Steps to take at once, up to the next state to store
+    int steps = 0;
+    bool store = false;
+    while (steps < maxSteps && !store && t < T) {
+      t += dt;
+      steps++;
+      store = writer.wanted(t,t >= T);
+    }
+
     // Find change
-    u = u + alpha*ddx2*u;
+    if (steps == 1) {
+      forwardEulerStep(now,next,nx,D*alpha);
+    } else {
+      forwardEulerSteps(now,next,nx,D*alpha,steps);
+    }
+    swap(now,next);
+
+    // Save current state to file, if wanted
+    if (store) {
+      writer.storeFrame(t,now);
+    }
+  }
 
-    // Add boundary conditions
-    u(0) = bc(0);
-    u(u.size()-1) = bc(1);
+  // Close savefile
+  writer.close();
+}
 
-    // Save current state to file
-    for (int i = 0; i < nx; i++) { outfile << u(i) << " "; }
-    outfile << endl;
+/*
+ * One forward Euler step of the inner points of a plate, rows shared among
+ * OpenMP threads on fine grids.
+ *
+ * @param u State now.
+ * @param uNew Set to the state after the step. Must not overlap u.
+ * @param nx Points along x, in a row.
+ * @param ny Points along y.
+ * @param r Diffusion constant times dt / dx^2.
+ */
+static void forwardEulerStep2D(const double* __restrict__ u,
+    double* __restrict__ uNew, int nx, int ny, double r) {
+#pragma omp parallel for schedule(static) if ((long) nx*ny > PARALLEL_MIN_POINTS)
+  for (int j = 1; j < ny-1; j++) {
+    long p0 = (long) j*nx;
+#pragma omp simd
+    for (int i = 1; i < nx-1; i++) {
+      uNew[p0 + i] = forwardEulerPoint2D(u,p0 + i,nx,r);
+    }
+  }
+}
 
-    t += dt;
+/*
+ * Several forward Euler steps of the inner points of a plate, by temporal
+ * tiling as for the rod. Tiles are TILE_WIDTH by TILE_HEIGHT points, read
+ * with steps points more on every side, and shrink by one on every side
+ * each step. The two tile arrays of a thread take 420 kB, so they stay in
+ * L2 also when two threads share it.
+ *
+ * @param u State now.
+ * @param uNew Set to the state after the steps. Must not overlap u.
+ * @param nx Points along x, in a row.
+ * @param ny Points along y.
+ * @param r Diffusion constant times dt / dx^2.
+ * @param steps Number of steps, at most TIME_BLOCK_2D.
+ */
+static void forwardEulerSteps2D(const double* __restrict__ u,
+    double* __restrict__ uNew, int nx, int ny, double r, int steps) {
+  int tilesX = (nx - 2 + TILE_WIDTH - 1) / TILE_WIDTH;
+  int tilesY = (ny - 2 + TILE_HEIGHT - 1) / TILE_HEIGHT;
+  int tileSize = (TILE_WIDTH + 2*TIME_BLOCK_2D + 2)*
+    (TILE_HEIGHT + 2*TIME_BLOCK_2D + 2);
+
+#pragma omp parallel if ((long) nx*ny > PARALLEL_MIN_POINTS)
+  {
+    vector<double> tiles[2];
+    tiles[0].resize(tileSize);
+    tiles[1].resize(tileSize);
+
+#pragma omp for collapse(2) schedule(static)
+    for (int m = 0; m < tilesY; m++) {
+      for (int n = 0; n < tilesX; n++) {
+        // Points of the tile, and of the plate they depend on
+        int i0 = 1 + n*TILE_WIDTH;
+        int i1 = min(i0 + TILE_WIDTH,nx-1);
+        int j0 = 1 + m*TILE_HEIGHT;
+        int j1 = min(j0 + TILE_HEIGHT,ny-1);
+        int ilo = max(0,i0 - steps);
+        int ihi = min(nx,i1 + steps);
+        int jlo = max(0,j0 - steps);
+        int jhi = min(ny,j1 + steps);
+
+        // Tiles have rows of w points, starting at (ilo,jlo). As for the
+        // rod, the second only needs the boundary points of the plate
+        long w = ihi - ilo;
+        double* now = tiles[0].data();
+        double* next = tiles[1].data();
+        bool boundary = ilo == 0 || jlo == 0 || ihi == nx || jhi == ny;
+        for (int j = jlo; j < jhi; j++) {
+          memcpy(now + (j - jlo)*w,u + (long) j*nx + ilo,w*sizeof(double));
+          if (boundary) {
+            memcpy(next + (j - jlo)*w,now + (j - jlo)*w,w*sizeof(double));
+          }
+        }
+
+        for (int s = 0; s < steps; s++) {
+          int iFrom = ilo == 0 ? 1 : ilo + s + 1;
+          int iTo = ihi == nx ? nx-1 : ihi - s - 1;
+          int jFrom = jlo == 0 ? 1 : jlo + s + 1;
+          int jTo = jhi == ny ? ny-1 : jhi - s - 1;
+          for (int j = jFrom; j < jTo; j++) {
+            long p0 = (j - jlo)*w - ilo;
+#pragma omp simd
+            for (int i = iFrom; i < iTo; i++) {
+              next[p0 + i] = forwardEulerPoint2D(now,p0 + i,w,r);
+            }
+          }
+          swap(now,next);
+        }
+
+        for (int j = j0; j < j1; j++) {
+          memcpy(uNew + (long) j*nx + i0,now + (j - jlo)*w + i0 - ilo,
+              (i1 - i0)*sizeof(double));
+        }
+      }
+    }
+  }
+}
+
+/*
+ * Forward Euler on the unit square, stable for dt <= dx^2/4. The five point
+ * stencil is applied directly, and steps between the states stored are
+ * taken TIME_BLOCK_2D at a time by temporal tiling. The boundary values are
+ * kept.
+ *
+ * @param dt Time step.
+ * @param T Runtime.
+ * @param dx Step size, in both directions.
+ * @param u Initial condition with the boundary values, x along rows. Set to
+ * the state at T.
+ * @param output Savefile, and which states to store.
+ * @param tiled False to take one step at a time.
+ */
+void forwardEulerDiffusion2D(double dt, double T, double dx, mat& u, OutputSettings output, bool tiled) {
+  int nx = u.n_rows;
+  int ny = u.n_cols;
+
+  // Time parameters
+  double t = 0;
+
+  // Physical constants
+  double D = 1;
+
+  // Check on alpha status
+  double alpha = dt / (dx*dx);
+  if (D*alpha > 0.25) {
+    cout << "Bad choice of steps sizes." << endl;
+  }
+
+  // Open savefile and write header
+  colvec x = linspace<colvec>(0, 1, nx);
+  DiffusionWriter writer(output,"ForwardEuler2D",T,dt,dx,x.memptr(),nx,ny,1);
+  writer.addFrame(t,u.memptr());
+
+  // Buffer for the next state, the boundary values stay
+  mat uNext = u;
+
+  double* now = u.memptr();
+  double* next = uNext.memptr();
+  int maxSteps = tiled ? TIME_BLOCK_2D : 1;
+  while (t < T) {
+    // Steps to take at once, up to the next state to store
+    int steps = 0;
+    bool store = false;
+    while (steps < maxSteps && !store && t < T) {
+      t += dt;
+      steps++;
+      store = writer.wanted(t,t >= T);
+    }
+
+    // Find change
+    if (steps == 1) {
+      forwardEulerStep2D(now,next,nx,ny,D*alpha);
+    } else {
+      forwardEulerSteps2D(now,next,nx,ny,D*alpha,steps);
+    }
+    swap(now,next);
+
+    // Save current state to file, if wanted
+    if (store) {
+      writer.storeFrame(t,now);
+    }
   }
 
   // Close savefile
-  outfile.close();
+  writer.close();
+
+  if (now != u.memptr()) {
+    u = uNext;
+  }
 }
 
 /*
+ * One step of the theta scheme of the inner points,
+ *   uNew_i - theta*r*L(uNew)_i = u_i + (1 - theta)*r*L(u)_i,
+ * where L is the three point stencil. Theta 1 is backward Euler and 1/2 is
+ * Crank-Nicolson. The right hand side is found with the stencil, and the
+ * system solved by the factored matrix.
+ *
+ * @param u State now.
+ * @param uNew Set to the state after the step. Must not overlap u, and
+ * must hold the boundary values.
+ * @param nx Number of points.
+ * @param r Diffusion constant times dt / dx^2.
+ * @param theta Weight of the implicit part.
+ * @param solver Factored matrix of the inner points,
+ * 1 + 2*theta*r on the diagonal and -theta*r beside it.
+ */
+static void implicitStep(const double* __restrict__ u,
+    double* __restrict__ uNew, int nx, double r, double theta,
+    const TridiagonalSolver& solver) {
+  double explicitR = (1 - theta)*r;
+  for (int i = 1; i < nx-1; i++) {
+    uNew[i] = u[i] + explicitR*(u[i-1] - 2*u[i] + u[i+1]);
+  }
+
+  // The boundary values are known, so they go on the right hand side
+  uNew[1] += theta*r*uNew[0];
+  uNew[nx-2] += theta*r*uNew[nx-1];
+
+  solver.solve(uNew + 1);
+}
+
+/*
+ * Backward Euler, unconditionally stable. Each step solves a tridiagonal
+ * system, factored once.
+ *
  * @param dt Time step.
  * @param T Runtime.
  * @param dx Step size.
  * @param ic Initial condition.
  * @param bc Boundary conditions.
- * @param filepath Path to savefile.
+ * @param output Savefile, and which states to store.
  */
-void backwardEulerDiffusion(double dt, double T, double dx, colvec ic, colvec bc, string filepath) {
+void backwardEulerDiffusion(double dt, double T, double dx, colvec ic, colvec bc, OutputSettings output) {
   // Spatial parameters
   double a = 0;
   double b = 1;
-  int nx = (b / dx) + 1;
+  int nx = ic.size();
   colvec x = linspace<colvec>(a, b, nx);
 
   // Time parameters
@@ -101,79 +411,60 @@ void backwardEulerDiffusion(double dt, double T, double dx, colvec ic, colvec bc
   // Physical constants
   double D = 1;
 
-  // Create central difference matrix
-  mat ddx2 = zeros(x.size(), x.size());
-  ddx2.diag(0).fill(-2);
-  ddx2.diag(1).fill(1);
-  ddx2.diag(-1).fill(1);
-
-  // Check on alpha status
   double alpha = dt / (dx*dx);
-  if (alpha > 0.5) {
-    cout << "Bad choice of steps sizes." << endl;
-  }
 
-  // Open savefile
-  ofstream outfile;
-  outfile.open(filepath.c_str());
+  // Open savefile and write header
+  DiffusionWriter writer(output,"BackwardEuler",T,dt,dx,x.memptr(),nx,1,1);
 
-  // Write header
-  outfile << "#HEADER#" << endl;
-  outfile << "Method: BackwardEuler" << endl;
-  outfile << "T: " << T << endl << "dt: " << dt << endl;
-  outfile << "dx: " << dx << endl;
-  outfile << "x: ";
-  for (int i = 0; i < nx; i++) { outfile << x(i) << " "; }
-  outfile << endl;
-  outfile << "#/HEADER#" << endl;
+  // Initial state, and a buffer for the next
+  colvec u = ic;
+  colvec uNext = ic;
 
-  // Initial state
-  colvec u = zeros(nx);
-  u = D*alpha*ddx2*ic;
-
-  // Add boundary conditions
-  u(0) = bc(0);
-  u(u.size()-1) = bc(1);
+  // Add boundary conditions, they stay in both buffers
+  u(0) = uNext(0) = bc(0);
+  u(nx-1) = uNext(nx-1) = bc(1);
 
   // Save initial state
-  for (int i = 0; i < nx; i++) { outfile << u(i) << " "; }
-  outfile << endl;
+  writer.addFrame(t,u.memptr());
 
-  // Need identity matrix
-  mat I = eye(nx,nx);
+  // The matrix of the inner points is the same every step
+  double theta = 1;
+  TridiagonalSolver solver(nx-2,-theta*D*alpha,1+2*theta*D*alpha,
+      -theta*D*alpha);
 
-  mat A; colvec B; colvec sol;
+  double* now = u.memptr();
+  double* next = uNext.memptr();
   while (t < T) {
     // Find change by solving linear set of equations
-    A = I - alpha*ddx2;
-    B = u;
-    sol = solve(A,B);
-    u(span(1,nx-2)) = sol(span(1,nx-2));
-
-    // Save current state to file
-    for (int i = 0; i < nx; i++) { outfile << u(i) << " "; }
-    outfile << endl;
+    implicitStep(now,next,nx,D*alpha,theta,solver);
+    swap(now,next);
 
     t += dt;
+
+    // Save current state to file, if wanted
+    writer.addFrame(t,now,t >= T);
   }
 
   // Close savefile
-  outfile.close();
+  writer.close();
 }
 
 /*
+ * Crank-Nicolson, second order in time. Each step solves a tridiagonal
+ * system, factored once.
+ *
  * @param dt Time step.
  * @param T Runtime.
  * @param dx Step size.
  * @param ic Initial condition.
  * @param bc Boundary conditions.
- * @param filepath Path to savefile.
+ * @param output Savefile, and which states to store.
  */
-void crankNicolsonDiffusion(double dt, double T, double dx, colvec ic, colvec bc, string filepath) {
+void crankNicolsonDiffusion(double dt, double T, double dx, colvec ic, colvec bc, OutputSettings output) {
   // Spatial parameters
   double a = 0;
   double b = 1;
-  double nx = b / dx;
+  int nx = ic.size();
   colvec x = linspace<colvec>(a, b, nx);
 
   // Time parameters
@@ -182,60 +473,40 @@ void crankNicolsonDiffusion(double dt, double T, double dx, colvec ic, colvec bc
   // Physical constants
   double D = 1;
 
-  // Create central difference matrix
-  mat ddx2 = zeros(x.size(), x.size());
-  ddx2.diag(0).fill(-2);
-  ddx2.diag(1).fill(1);
-  ddx2.diag(-1).fill(1);
-
   double alpha = dt / (dx*dx);
 
-  // Open savefile
-  ofstream outfile;
-  outfile.open(filepath.c_str());
-
-  // Write header
-  outfile << "#HEADER#" << endl;
-  outfile << "Method: CrankNicolson" << endl;
-  outfile << "T: " << T << endl << "dt: " << dt << endl;
-  outfile << "dx: " << dx << endl;
-  outfile << "x: ";
-  for (int i = 0; i < nx; i++) { outfile << x(i) << " "; }
-  outfile << endl;
-  outfile << "#/HEADER#" << endl;
+  // Open savefile and write header
+  DiffusionWriter writer(output,"CrankNicolson",T,dt,dx,x.memptr(),nx,1,1);
 
-  // Initial state
-  colvec u = D*alpha*ddx2*ic;
+  // Initial state, and a buffer for the next
+  colvec u = ic;
+  colvec uNext = ic;
 
-  // Add boundary conditions
-  u(0) = bc(0);
-  u(u.size()-1) = bc(1);
+  // Add boundary conditions, they stay in both buffers
+  u(0) = uNext(0) = bc(0);
+  u(nx-1) = uNext(nx-1) = bc(1);
 
   // Save initial state
-  for (int i = 0; i < nx; i++) { outfile << u(i) << " "; }
-  outfile << endl;
+  writer.addFrame(t,u.memptr());
 
-  // Need identity matrix
-  mat I = eye(nx,nx);
+  // The matrix of the inner points is the same every step
+  double theta = 0.5;
+  TridiagonalSolver solver(nx-2,-theta*D*alpha,1+2*theta*D*alpha,
+      -theta*D*alpha);
 
-  mat A; colvec B;
+  double* now = u.memptr();
+  double* next = uNext.memptr();
   while (t < T) {
-    // Solve equation to find change
-    A = I - 0.5*alpha*ddx2;
-    B = (I + 0.5*alpha*ddx2)*u;
-    u = solve(A,B);
-
-    // Add boundary conditions
-    u(0) = bc(0);
-    u(u.size()-1) = bc(1);
-
-    // Save current state to file
-    for (int i = 0; i < nx; i++) { outfile << u(i) << " "; }
-    outfile << endl;
+    // Find change by solving linear set of equations
+    implicitStep(now,next,nx,D*alpha,theta,solver);
+    swap(now,next);
 
     t += dt;
+
+    // Save current state to file, if wanted
+    writer.addFrame(t,now,t >= T);
   }
 
   // Close savefile
-  outfile.close();
+  writer.close();
 }
@@ -1,5 +1,8 @@
 #include <armadillo>
 
-void forwardEulerDiffusion(double dt, double T, double dx, arma::colvec ic, arma::colvec bc, std::string filepath);
-void backwardEulerDiffusion(double dt, double T, double dx, arma::colvec ic, arma::colvec bc, std::string filepath);
-void crankNicolsonDiffusion(double dt, double T, double dx, arma::colvec ic, arma::colvec bc, std::string filepath);
+#include "DiffusionWriter.hpp"
+
+void forwardEulerDiffusion(double dt, double T, double dx, arma::colvec ic, arma::colvec bc, OutputSettings output, bool tiled = true);
+void forwardEulerDiffusion2D(double dt, double T, double dx, arma::mat& u, OutputSettings output, bool tiled = true);
+void backwardEulerDiffusion(double dt, double T, double dx, arma::colvec ic, arma::colvec bc, OutputSettings output);
+void crankNicolsonDiffusion(double dt, double T, double dx, arma::colvec ic, arma::colvec bc, OutputSettings output);
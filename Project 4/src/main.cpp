@@ -1,7 +1,13 @@
 #include <iostream>
+#include <sstream>
+#include <cstring>
 #include <armadillo>
+#ifdef __SSE2__
+#include <pmmintrin.h>
+#endif
 
 #include "diffusionIntegration.hpp"
+#include "diffusionADI.hpp"
 
 using namespace std;
 using namespace arma;
@@ -9,16 +15,63 @@ using namespace arma;
 // Time constants
 const double T = 1;
 
+/*
+ * Usage:
+ *   ./<exe> 1/2/3/4/5/6 dx dt savefile [-saveEach <k>] [-saveTimes <t1,t2,...>]
+ *            [-untiled]
+ *
+ * The savefile is binary, see DiffusionWriter.hpp. The first and last states
+ * are always stored. The rod is also stored every step, unless -saveEach or
+ * -saveTimes is given. Then every k-th step and the steps nearest the given
+ * times are stored.
+ *
+ * Forward Euler takes the steps between stored states several at a time by
+ * temporal tiling, unless -untiled is given. The result is the same bit for
+ * bit.
+ */
 int main(int argc, char* argv[]) {
-  if (argc != 5) {
-    cout << "Usage: <exe> 1/2/3 dx dt savefile" << endl << "1: FE, 2: BE, 3: CN" << endl;
+  string usage = "Usage: <exe> 1/2/3/4/5/6 dx dt savefile [-saveEach <k>] "
+    "[-saveTimes <t1,t2,...>] [-untiled]\n1: FE, 2: BE, 3: CN, 4: ADI plate, "
+    "5: ADI block, 6: FE plate";
+  if (argc < 5) {
+    cout << usage << endl;
     return 1;
   }
 
   int method = atoi(argv[1]);
   double dx = atof(argv[2]);
   double dt = atof(argv[3]);
-  string savefile = argv[4];
+
+  OutputSettings output;
+  output.filepath = argv[4];
+  output.saveEach = -1;
+  bool tiled = true;
+  for (int i = 5; i < argc; i++) {
+    if (strcmp(argv[i],"-saveEach") == 0 && i+1 < argc) {
+      output.saveEach = atoi(argv[++i]);
+    } else if (strcmp(argv[i],"-saveTimes") == 0 && i+1 < argc) {
+      stringstream times(argv[++i]);
+      string time;
+      while (getline(times,time,',')) {
+        output.saveTimes.push_back(atof(time.c_str()));
+      }
+    } else if (strcmp(argv[i],"-untiled") == 0) {
+      tiled = false;
+    } else {
+      cout << usage << endl;
+      return 1;
+    }
+  }
+  if (output.saveEach < 0) {
+    output.saveEach = method <= 3 && output.saveTimes.empty() ? 1 : 0;
+  }
+
+#ifdef __SSE2__
+  // Far from the boundary the implicit schemes give tiny values, which are
+  // very slow as subnormal numbers. Flush them to zero.
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+  _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+#endif
 
   // Initial condition
   int nx = (1.0 / dx) + 1;
@@ -29,14 +82,38 @@ int main(int argc, char* argv[]) {
 
   switch (method) {
     case 1:
-      forwardEulerDiffusion(dt,T,dx,ic,bc,savefile);
+      forwardEulerDiffusion(dt,T,dx,ic,bc,output,tiled);
       break;
     case 2:
-      backwardEulerDiffusion(dt,T,dx,ic,bc,savefile);
+      backwardEulerDiffusion(dt,T,dx,ic,bc,output);
       break;
     case 3:
-      crankNicolsonDiffusion(dt,T,dx,ic,bc,savefile);
+      crankNicolsonDiffusion(dt,T,dx,ic,bc,output);
+      break;
+    case 4: {
+      // Plate with the edge at x = 0 held at bc(0), the others at bc(1)
+      mat plate = bc(1)*ones(nx,nx);
+      plate.row(0).fill(bc(0));
+      plate(span(1,nx-2),span(1,nx-2)).zeros();
+      peacemanRachfordDiffusion2D(dt,T,dx,plate,output);
+      break;
+    }
+    case 5: {
+      // Block with the face at x = 0 held at bc(0), the others at bc(1)
+      cube block = bc(1)*ones<cube>(nx,nx,nx);
+      block.subcube(0,0,0,0,nx-1,nx-1).fill(bc(0));
+      block.subcube(1,1,1,nx-2,nx-2,nx-2).zeros();
+      douglasDiffusion3D(dt,T,dx,block,output);
+      break;
+    }
+    case 6: {
+      // Plate with the edge at x = 0 held at bc(0), the others at bc(1)
+      mat plate = bc(1)*ones(nx,nx);
+      plate.row(0).fill(bc(0));
+      plate(span(1,nx-2),span(1,nx-2)).zeros();
+      forwardEulerDiffusion2D(dt,T,dx,plate,output,tiled);
       break;
+    }
   }
 
   cout << "Reached end of main." << endl;